@@ -0,0 +1,241 @@
+// Accuracy test and microbenchmark for every kernel in fastmath.h: measures the maximum error of the scalar and batch
+// kernels against libm over a sweep of inputs and checks it against the kernel's documented bound, then times libm,
+// the scalar kernel, and the batch kernel on the same inputs. Exits non-zero if any kernel exceeds its bound.
+
+#include "rtweekend.h"
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+const size_t n = 1 << 20;       // inputs per accuracy sweep
+const size_t timed = 1 << 12;   // elements per timing pass: small enough that every array stays in cache
+const int passes = 5000;
+
+// nanoseconds per element of body(), which processes timed elements per call
+double time_per_element(const std::function<void()>& body) {
+    body();     // warm up caches
+    auto start = std::chrono::steady_clock::now();
+    for (int p = 0; p < passes; p++)
+        body();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (double(timed) * passes);
+}
+
+// keeps results observable so the timed loops aren't optimized away
+volatile double sink;
+
+// Element count for the timed loops, hidden from the compiler: with a known count it would vectorize the libm and
+// scalar loops like the batch kernels, while the renderer calls these kernels one sample at a time
+volatile size_t opaque_timed = timed;
+
+// One result per timed array: the arrays are read again after timing, so their stores stay, and summing them all
+// would add a serial chain of additions slower than most kernels
+double checksum(const std::vector<double>& v) {
+    return v[timed - 1];
+}
+
+bool all_within = true;
+
+std::string speedup(double ratio) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(2) << ratio << "x";
+    return text.str();
+}
+
+// error is the larger of the scalar and batch kernels' errors; speedups are scalar over libm, and batch over scalar
+void report(const std::string& kernel, double error, double bound, double libm_ns, double fast_ns, double batch_ns) {
+    bool ok = error <= bound;
+    all_within &= ok;
+    std::cout << std::left << std::setw(22) << kernel
+              << std::scientific << std::setprecision(2) << std::setw(12) << error << std::setw(12) << bound
+              << std::setw(7) << (ok ? "ok" : "FAIL")
+              << std::fixed << std::setprecision(2) << std::setw(10) << libm_ns << std::setw(10) << fast_ns;
+    if (batch_ns > 0)
+        std::cout << std::setw(10) << batch_ns << std::setw(10) << speedup(libm_ns / fast_ns) << speedup(fast_ns / batch_ns);
+    else
+        std::cout << std::setw(10) << "-" << std::setw(10) << speedup(libm_ns / fast_ns) << "-";
+    std::cout << "\n";
+}
+
+// Pre-generated uniforms for the rejection samplers fastmath.h replaces, which take as many as their tries need
+struct uniform_stream {
+    std::vector<double> values;
+    size_t next = 0;
+
+    double operator()(double min, double max) {
+        if (next == values.size())
+            next = 0;
+        return min + (max - min) * values[next++];
+    }
+};
+
+// the rejection samplers, as vec3.h implements them without RT_FAST_MATH
+vec3 rejection_in_unit_disk(uniform_stream& u) {
+    while (true) {
+        auto p = vec3(u(-1,1), u(-1,1), 0);
+        if (p.length_squared() < 1)
+            return p;
+    }
+}
+
+vec3 rejection_in_unit_ball(uniform_stream& u) {
+    while (true) {
+        auto p = vec3(u(-1,1), u(-1,1), u(-1,1));
+        if (p.length_squared() < 1)
+            return p;
+    }
+}
+
+vec3 rejection_unit_vector(uniform_stream& u) {
+    auto p = rejection_in_unit_ball(u);
+    return p / p.length();
+}
+
+int main() {
+    std::vector<double> in(n), out(n), u1(n), u2(n), u3(n), x(n), y(n), z(n);
+    const size_t count = opaque_timed;
+
+    std::cout << std::left << std::setw(22) << "kernel" << std::setw(12) << "max error" << std::setw(12) << "bound"
+              << std::setw(7) << "" << std::setw(10) << "libm ns" << std::setw(10) << "fast ns" << std::setw(10) << "batch ns"
+              << std::setw(10) << "fast/libm" << "batch/fast\n";
+
+    // rsqrt: relative error over many decades, as unit_vector sees squared lengths of all scales
+    {
+        double error = 0;
+        for (size_t i = 0; i < n; i++)
+            in[i] = std::pow(10.0, random_double(-12, 12));
+        fast_rsqrt_batch(in.data(), out.data(), n);
+        for (size_t i = 0; i < n; i++)
+            error = std::fmax(error, std::fmax(std::fabs(fast_rsqrt(in[i]) * std::sqrt(in[i]) - 1), std::fabs(out[i] * std::sqrt(in[i]) - 1)));
+        double libm = time_per_element([&] { for (size_t i = 0; i < count; i++) out[i] = 1.0 / std::sqrt(in[i]); sink = checksum(out); });
+        double fast = time_per_element([&] { for (size_t i = 0; i < count; i++) out[i] = fast_rsqrt(in[i]); sink = checksum(out); });
+        double batch = time_per_element([&] { fast_rsqrt_batch(in.data(), out.data(), count); sink = checksum(out); });
+        report("rsqrt", error, fast_rsqrt_max_rel_error, libm, fast, batch);
+    }
+
+    // gamma: linear_to_gamma's sqrt over the [0,1] range pixels are clamped to, and the negative values it maps to 0
+    {
+        double error = 0;
+        for (size_t i = 0; i < n; i++)
+            in[i] = random_double(-0.01, 1);
+        fast_gamma_batch(in.data(), out.data(), n);
+        for (size_t i = 0; i < n; i++) {
+            if (in[i] > 0)
+                error = std::fmax(error, std::fmax(std::fabs(fast_sqrt(in[i]) / std::sqrt(in[i]) - 1), std::fabs(out[i] / std::sqrt(in[i]) - 1)));
+            else
+                error = std::fmax(error, std::fabs(out[i]));
+        }
+        double libm = time_per_element([&] { for (size_t i = 0; i < count; i++) out[i] = in[i] > 0 ? std::sqrt(in[i]) : 0; sink = checksum(out); });
+        double fast = time_per_element([&] { for (size_t i = 0; i < count; i++) out[i] = in[i] > 0 ? fast_sqrt(in[i]) : 0; sink = checksum(out); });
+        double batch = time_per_element([&] { fast_gamma_batch(in.data(), out.data(), count); sink = checksum(out); });
+        report("gamma (sqrt)", error, fast_rsqrt_max_rel_error, libm, fast, batch);
+    }
+
+    // pow5: Schlick's (1 - cos)^5, arguments in [0,2]
+    {
+        double error = 0;
+        for (size_t i = 0; i < n; i++)
+            in[i] = random_double(0, 2);
+        fast_pow5_batch(in.data(), out.data(), n);
+        for (size_t i = 0; i < n; i++) {
+            double exact = std::pow(in[i], 5);
+            if (exact > 0)
+                error = std::fmax(error, std::fmax(std::fabs(fast_pow5(in[i]) / exact - 1), std::fabs(out[i] / exact - 1)));
+        }
+        double libm = time_per_element([&] { for (size_t i = 0; i < count; i++) out[i] = std::pow(in[i], 5); sink = checksum(out); });
+        double fast = time_per_element([&] { for (size_t i = 0; i < count; i++) out[i] = fast_pow5(in[i]); sink = checksum(out); });
+        double batch = time_per_element([&] { fast_pow5_batch(in.data(), out.data(), count); sink = checksum(out); });
+        report("pow5", error, fast_pow5_max_rel_error, libm, fast, batch);
+    }
+
+    // cbrt: radii for points in the unit ball
+    {
+        double error = 0;
+        for (size_t i = 0; i < n; i++) {
+            in[i] = random_double();
+            if (in[i] > 1e-300)
+                error = std::fmax(error, std::fabs(fast_cbrt(in[i]) / std::cbrt(in[i]) - 1));
+        }
+        double libm = time_per_element([&] { for (size_t i = 0; i < count; i++) out[i] = std::cbrt(in[i]); sink = checksum(out); });
+        double fast = time_per_element([&] { for (size_t i = 0; i < count; i++) out[i] = fast_cbrt(in[i]); sink = checksum(out); });
+        report("cbrt", error, fast_cbrt_max_rel_error, libm, fast, 0);
+    }
+
+    // sincos over the full [-pi, pi] range the samplers use
+    {
+        double error = 0;
+        for (size_t i = 0; i < n; i++) {
+            in[i] = pi * (2 * random_double() - 1);
+            double s, c;
+            fast_sincos(in[i], s, c);
+            error = std::fmax(error, std::fmax(std::fabs(s - std::sin(in[i])), std::fabs(c - std::cos(in[i]))));
+        }
+        double libm = time_per_element([&] { for (size_t i = 0; i < count; i++) { x[i] = std::sin(in[i]); y[i] = std::cos(in[i]); } sink = checksum(x) + checksum(y); });
+        double fast = time_per_element([&] { for (size_t i = 0; i < count; i++) fast_sincos(in[i], x[i], y[i]); sink = checksum(x) + checksum(y); });
+        report("sincos", error, fast_sincos_max_abs_error, libm, fast, 0);
+    }
+
+    // Sampling: the direct mappings, scalar and batch, against the same mappings computed with libm. All three columns
+    // read pre-generated uniforms: the direct mappings two or three per point, the rejection loops they replace (the
+    // libm column) as many as their tries take.
+    uniform_stream stream;
+    for (size_t i = 0; i < n; i++) {
+        u1[i] = random_double();
+        u2[i] = random_double();
+        u3[i] = random_double();
+    }
+    for (size_t i = 0; i < 8 * n; i++)
+        stream.values.push_back(random_double());
+
+    {
+        double error = 0;
+        fast_unit_sphere_direction_batch(u1.data(), u2.data(), x.data(), y.data(), z.data(), n);
+        for (size_t i = 0; i < n; i++) {
+            double px, py, pz;
+            fast_unit_sphere_direction(u1[i], u2[i], px, py, pz);
+            double ez = 1 - 2 * u1[i], r = std::sqrt(1 - ez * ez), phi = pi * (2 * u2[i] - 1);
+            error = std::fmax(error, std::fmax(std::fabs(px - r * std::cos(phi)), std::fmax(std::fabs(py - r * std::sin(phi)), std::fabs(pz - ez))));
+            error = std::fmax(error, std::fmax(std::fabs(x[i] - r * std::cos(phi)), std::fmax(std::fabs(y[i] - r * std::sin(phi)), std::fabs(z[i] - ez))));
+        }
+        double libm = time_per_element([&] { for (size_t i = 0; i < count; i++) { auto p = rejection_unit_vector(stream); x[i] = p.x(); } sink = checksum(x); });
+        double fast = time_per_element([&] { for (size_t i = 0; i < count; i++) fast_unit_sphere_direction(u1[i], u2[i], x[i], y[i], z[i]); sink = checksum(x); });
+        double batch = time_per_element([&] { fast_unit_sphere_direction_batch(u1.data(), u2.data(), x.data(), y.data(), z.data(), count); sink = checksum(x); });
+        report("unit sphere direction", error, fast_sampling_max_abs_error, libm, fast, batch);
+    }
+
+    {
+        double error = 0;
+        for (size_t i = 0; i < n; i++) {
+            double px, py, pz;
+            fast_unit_ball_point(u1[i], u2[i], u3[i], px, py, pz);
+            double ez = 1 - 2 * u1[i], r = std::sqrt(1 - ez * ez), phi = pi * (2 * u2[i] - 1), radius = std::cbrt(u3[i]);
+            error = std::fmax(error, std::fmax(std::fabs(px - radius * r * std::cos(phi)),
+                                     std::fmax(std::fabs(py - radius * r * std::sin(phi)), std::fabs(pz - radius * ez))));
+        }
+        double libm = time_per_element([&] { for (size_t i = 0; i < count; i++) { auto p = rejection_in_unit_ball(stream); x[i] = p.x(); } sink = checksum(x); });
+        double fast = time_per_element([&] { for (size_t i = 0; i < count; i++) fast_unit_ball_point(u1[i], u2[i], u3[i], x[i], y[i], z[i]); sink = checksum(x); });
+        report("unit ball point", error, fast_sampling_max_abs_error, libm, fast, 0);
+    }
+
+    {
+        double error = 0;
+        fast_unit_disk_point_batch(u1.data(), u2.data(), x.data(), y.data(), n);
+        for (size_t i = 0; i < n; i++) {
+            double px, py;
+            fast_unit_disk_point(u1[i], u2[i], px, py);
+            double radius = std::sqrt(u1[i]), phi = pi * (2 * u2[i] - 1);
+            error = std::fmax(error, std::fmax(std::fabs(px - radius * std::cos(phi)), std::fabs(py - radius * std::sin(phi))));
+            error = std::fmax(error, std::fmax(std::fabs(x[i] - radius * std::cos(phi)), std::fabs(y[i] - radius * std::sin(phi))));
+        }
+        double libm = time_per_element([&] { for (size_t i = 0; i < count; i++) { auto p = rejection_in_unit_disk(stream); x[i] = p.x(); } sink = checksum(x); });
+        double fast = time_per_element([&] { for (size_t i = 0; i < count; i++) fast_unit_disk_point(u1[i], u2[i], x[i], y[i]); sink = checksum(x); });
+        double batch = time_per_element([&] { fast_unit_disk_point_batch(u1.data(), u2.data(), x.data(), y.data(), count); sink = checksum(x); });
+        report("unit disk point", error, fast_sampling_max_abs_error, libm, fast, batch);
+    }
+
+    std::cout << "(every column reads the same pre-generated inputs; for sampling rows the libm column is the rejection loop)\n";
+    return all_within ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+// Checks and measures incremental_renderer: converges a scene, applies an edit, and re-renders only the invalidated
+// pixels. Pixels that were not invalidated must keep their samples bit for bit, invalidated ones must be resampled,
+// and both must match a full render of the edited scene up to noise (measured between two full renders), so that
+// no pixel the edit changed kept stale samples. Reports how many pixels each edit invalidated and the re-render time
+// against a full render. Exits non-zero if a check fails.
+// usage: incremental [image_width] [samples_per_pixel]
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "incremental.h"
+#include "scenes.h"
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+bool all_passed = true;
+
+void check(bool ok, const std::string& what) {
+    all_passed &= ok;
+    std::cout << (ok ? "  ok    " : "  FAIL  ") << what << "\n";
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<color> image_of(const incremental_renderer& renderer, const camera& cam) {
+    std::vector<color> image;
+    for (int row = 0; row < cam.height(); row++)
+        for (int col = 0; col < cam.image_width; col++)
+            image.push_back(renderer.pixel_color(col, row));
+    return image;
+}
+
+// mean absolute difference per channel, over the pixels where select[i] holds
+double mean_difference(const std::vector<color>& a, const std::vector<color>& b, const std::vector<bool>& select, bool value) {
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (select[i] != value)
+            continue;
+        count++;
+        for (int c = 0; c < 3; c++)
+            sum += std::fabs(a[i][c] - b[i][c]);
+    }
+    return count ? sum / (3.0 * count) : 0;
+}
+
+// matches up to noise: a little above the difference between two independent full renders
+bool within_noise(double difference, double noise) {
+    return difference <= 1.15 * noise;
+}
+
+// runs one edit on a converged renderer of the scene and checks the result
+void check_edit(const std::string& title, scene_builder build, int width, int spp,
+                const std::function<int(incremental_renderer&, hittable_list&)>& edit) {
+    hittable_list world;
+    camera cam;
+    build(world, cam);
+    cam.image_width = width;
+    cam.samples_per_pixel = spp;
+    cam.threads = 0;
+    cam.initialize();
+
+    incremental_renderer renderer(world, cam);
+    auto start = std::chrono::steady_clock::now();
+    renderer.converge();
+    double full_seconds = seconds_since(start);
+    auto before = image_of(renderer, cam);
+
+    int invalidated = edit(renderer, world);
+    std::vector<bool> kept;
+    for (int row = 0; row < cam.height(); row++)
+        for (int col = 0; col < cam.image_width; col++)
+            kept.push_back(renderer.pixel_samples(col, row) == spp);
+
+    start = std::chrono::steady_clock::now();
+    int resampled = renderer.converge();
+    double edit_seconds = seconds_since(start);
+    auto after = image_of(renderer, cam);
+
+    // two independent full renders of the edited scene: the reference, and a measure of noise alone
+    incremental_renderer full(world, cam), again(world, cam);
+    full.converge();
+    again.converge();
+    auto reference = image_of(full, cam), noise = image_of(again, cam);
+
+    bool kept_identical = true;
+    size_t kept_count = 0;
+    for (size_t i = 0; i < after.size(); i++)
+        if (kept[i]) {
+            kept_count++;
+            for (int c = 0; c < 3; c++)
+                kept_identical &= (after[i][c] == before[i][c]);
+        }
+
+    double kept_error = mean_difference(after, reference, kept, true), kept_noise = mean_difference(noise, reference, kept, true);
+    double new_error = mean_difference(after, reference, kept, false), new_noise = mean_difference(noise, reference, kept, false);
+    double stale_error = mean_difference(before, reference, kept, false);
+
+    std::cout << std::fixed << std::setprecision(4) << title << " (" << cam.image_width << "x" << cam.height()
+              << ", " << spp << " spp)\n"
+              << "  invalidated " << invalidated << " of " << after.size() << " pixels ("
+              << std::setprecision(1) << 100.0 * invalidated / after.size() << "%), re-render "
+              << std::setprecision(3) << edit_seconds << " s vs full " << full_seconds << " s\n"
+              << std::setprecision(5) << "  mean difference to a full render (noise): kept pixels " << kept_error
+              << " (" << kept_noise << "), resampled " << new_error << " (" << new_noise << "), before the edit "
+              << stale_error << "\n";
+
+    check(resampled == invalidated && kept_count + invalidated == after.size(), "exactly the invalidated pixels are resampled");
+    check(kept_identical, "pixels that were not invalidated keep their samples");
+    check(within_noise(kept_error, kept_noise), "kept pixels match a full render of the edited scene up to noise");
+    check(within_noise(new_error, new_noise), "resampled pixels match a full render of the edited scene up to noise");
+    // the edit shows: the samples it threw away differ from the edited scene by more than noise (diluted by the pixels
+    // invalidated to be safe but left unchanged, so without within_noise's margin)
+    check(invalidated > 0 && stale_error > new_noise, "the edit changed the invalidated pixels");
+}
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? std::stoi(argv[1]) : 80;
+    int spp = argc > 2 ? std::stoi(argv[2]) : 64;
+
+    // world.objects[1] is three_spheres' center sphere
+    auto center_sphere = [](hittable_list& world) { return std::dynamic_pointer_cast<sphere>(world.objects[1]); };
+
+    check_edit("three_spheres: recolor the center sphere", three_spheres, width, spp,
+               [&](incremental_renderer& renderer, hittable_list& world) {
+        return renderer.set_material(*center_sphere(world), make_shared<lambertian>(color(0.6, 0.1, 0.1)));
+    });
+
+    check_edit("three_spheres: move the center sphere 0.3 left", three_spheres, width, spp,
+               [&](incremental_renderer& renderer, hittable_list& world) {
+        auto s = center_sphere(world);
+        return renderer.move_sphere(*s, s->center_at(0) + vec3(0, 0, 0.3));
+    });
+
+    // look-dev on a detail: the small sphere of bouncing_spheres closest to a spot in plain view of the camera
+    auto small_sphere = [](hittable_list& world) {
+        shared_ptr<sphere> closest;
+        for (const auto& object : world.objects) {
+            auto s = std::dynamic_pointer_cast<sphere>(object);
+            if (s && s->get_radius() < 1 && (!closest
+                || (s->center_at(0) - point3(6, 0.2, 1.5)).length() < (closest->center_at(0) - point3(6, 0.2, 1.5)).length()))
+                closest = s;
+        }
+        return closest;
+    };
+
+    check_edit("bouncing_spheres: recolor a small sphere", bouncing_spheres, width, spp,
+               [&](incremental_renderer& renderer, hittable_list& world) {
+        return renderer.set_material(*small_sphere(world), make_shared<lambertian>(color(0.1, 0.8, 0.1)));
+    });
+
+    check_edit("bouncing_spheres: move a small sphere 0.3 right", bouncing_spheres, width, spp,
+               [&](incremental_renderer& renderer, hittable_list& world) {
+        auto s = small_sphere(world);
+        return renderer.move_sphere(*s, s->center_at(0) + vec3(0, 0, -0.3));
+    });
+
+    return all_passed ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+// Renders the bouncing spheres scene in NUMA mode on one socket, then on every socket with plain shared tiles (the
+// NUMA-unaware baseline, same core count) and in NUMA mode, and reports the scaling and NUMA mode's gain over it.
+// usage: numa_scaling [image_width] [samples_per_pixel]
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "scenes.h"
+#include "topology.h"
+
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+// renders once in NUMA mode with the given node count and returns wall time in seconds
+double time_render(const hittable& world, camera cam, int nodes, bool replicate) {
+    cam.numa_aware = true;
+    cam.numa_nodes = nodes;
+    cam.replicate_scene = replicate;
+
+    std::ostringstream image;
+    auto start = std::chrono::steady_clock::now();
+    cam.render(world, image);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// renders once NUMA-unaware: the shared tile queue on threads unpinned workers
+double time_shared_render(const hittable& world, camera cam, int threads) {
+    cam.numa_aware = false;
+    cam.threads = threads;
+
+    std::ostringstream image;
+    auto start = std::chrono::steady_clock::now();
+    cam.render(world, image);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    hittable_list world;
+    camera cam;
+    bouncing_spheres(world, cam);
+
+    // smaller than the final render by default, so that a run takes seconds
+    cam.image_width = argc > 1 ? std::stoi(argv[1]) : 400;
+    cam.samples_per_pixel = argc > 2 ? std::stoi(argv[2]) : 10;
+    cam.threads = 0;
+
+    auto topo = cpu_topology::detect();
+    int node_count = int(topo.nodes.size());
+    double samples = double(cam.image_width) * int(cam.image_width / cam.aspect_ratio) * cam.samples_per_pixel;
+
+    std::cout << "nodes: " << node_count << ", cores: " << topo.core_count() << "\n";
+    for (int n = 0; n < node_count; n++)
+        std::cout << "  node " << n << ": " << topo.nodes[n].size() << " cores\n";
+    if (node_count < 2)
+        std::cout << "single NUMA node: the rows below all measure the same configuration\n";
+
+    std::cout << std::left << std::setw(28) << "configuration"
+              << std::setw(12) << "seconds"
+              << std::setw(14) << "Msamples/s"
+              << "speedup\n";
+
+    double baseline = 0;
+    auto report = [&](const std::string& name, double seconds) {
+        if (baseline == 0) baseline = seconds;
+        std::cout << std::left << std::setw(28) << name
+                  << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+                  << std::setw(14) << samples / seconds / 1e6
+                  << std::setprecision(2) << baseline / seconds << "x\n";
+    };
+
+    report("one socket", time_render(world, cam, 1, false));
+    double naive = time_shared_render(world, cam, topo.core_count());
+    report("all sockets, NUMA-unaware", naive);
+    double numa = time_render(world, cam, node_count, false);
+    report("all sockets", numa);
+    double replicated = time_render(world, cam, node_count, true);
+    report("all sockets, replicated", replicated);
+
+    std::cout << std::setprecision(2) << "NUMA mode over NUMA-unaware on " << topo.core_count() << " cores: "
+              << naive / numa << "x, replicated " << naive / replicated << "x\n";
+}
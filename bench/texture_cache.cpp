@@ -0,0 +1,202 @@
+// Checks and measures the texture cache on generated P6 images: every tile of every mip level against a pyramid
+// computed in memory, two images whose ids are 65536 apart, random lookups under a budget that holds the whole image,
+// and renders of a textured sphere from far away (coarse levels only) and close up under a small budget. Exits
+// non-zero if any check fails.
+// usage: texture_cache [directory]
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "texture.h"
+#include "texture_cache.h"
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+bool all_passed = true;
+
+void check(bool ok, const std::string& what) {
+    all_passed &= ok;
+    std::cout << (ok ? "  ok    " : "  FAIL  ") << what << "\n";
+}
+
+// texels of one image level, gamma encoded RGB bytes, rows top to bottom
+struct level_image {
+    int width = 0, height = 0;
+    std::vector<unsigned char> rgb;
+};
+
+// a pattern without large flat areas, so that misplaced tiles or texels change the bytes
+level_image make_pattern(int width, int height) {
+    level_image image{width, height, std::vector<unsigned char>(3 * size_t(width) * height)};
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            unsigned char* t = &image.rgb[3 * (size_t(y) * width + x)];
+            t[0] = (unsigned char)(x * 7 + y * 3);
+            t[1] = (unsigned char)((x ^ y) * 5);
+            t[2] = (unsigned char)(((x / 16 + y / 16) % 2) * 200 + y % 50);
+        }
+    return image;
+}
+
+void write_p6(const std::string& path, const level_image& image) {
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n# generated by bench/texture_cache\n" << image.width << " " << image.height << "\n255\n";
+    out.write(reinterpret_cast<const char*>(image.rgb.data()), std::streamsize(image.rgb.size()));
+}
+
+// the next mip level, filtered the way tiled_image builds its pyramid: 2x2 box in linear space, gamma 2 re-encoded
+level_image half(const level_image& fine) {
+    level_image coarse{std::max(1, fine.width / 2), std::max(1, fine.height / 2), {}};
+    coarse.rgb.resize(3 * size_t(coarse.width) * coarse.height);
+    for (int y = 0; y < coarse.height; y++)
+        for (int x = 0; x < coarse.width; x++)
+            for (int c = 0; c < 3; c++) {
+                double sum = 0;
+                for (int fy : { 2*y, std::min(2*y + 1, fine.height - 1) })
+                    for (int fx : { 2*x, std::min(2*x + 1, fine.width - 1) }) {
+                        double value = fine.rgb[3 * (size_t(fy) * fine.width + fx) + c] / 255.0;
+                        sum += value * value;
+                    }
+                coarse.rgb[3 * (size_t(y) * coarse.width + x) + c] = (unsigned char)(255.0 * std::sqrt(0.25 * sum) + 0.5);
+            }
+    return coarse;
+}
+
+// every tile of every level, read through a cache, equals the in-memory pyramid
+bool pyramid_matches(texture_cache& cache, const tiled_image& image, level_image level) {
+    const int ts = tiled_image::tile_size;
+    for (int l = 0; l < image.levels(); l++, level = half(level)) {
+        if (image.level_width(l) != level.width || image.level_height(l) != level.height)
+            return false;
+        for (int ty = 0; ty * ts < level.height; ty++)
+            for (int tx = 0; tx * ts < level.width; tx++) {
+                auto t = cache.tile(image, l, tx, ty);
+                for (int y = 0; y < t->height; y++)
+                    for (int x = 0; x < t->width; x++)
+                        for (int c = 0; c < 3; c++)
+                            if (t->rgb[3 * (size_t(y) * t->width + x) + c]
+                                != level.rgb[3 * (size_t(ty * ts + y) * level.width + tx * ts + x) + c])
+                                return false;
+            }
+    }
+    return true;
+}
+
+// renders a sphere covered by the image through the global cache, from the given distance
+void render_textured_sphere(const std::string& filename, double distance) {
+    hittable_list world;
+    world.add(make_shared<sphere>(point3(0,0,0), 1.0, make_shared<lambertian>(make_shared<image_texture>(filename))));
+
+    camera cam;
+    cam.aspect_ratio = 1.0;
+    cam.image_width = 200;
+    cam.samples_per_pixel = 4;
+    cam.max_depth = 4;
+    cam.v_fov = 40;
+    cam.lookfrom = point3(0, 0, distance);
+    cam.lookat = point3(0, 0, 0);
+    cam.focus_dist = distance;
+    cam.threads = 0;
+
+    std::ostringstream image;
+    cam.render(world, image);
+}
+
+int main(int argc, char* argv[]) {
+    std::filesystem::path dir = argc > 1 ? argv[1] : std::filesystem::temp_directory_path() / "rt_texture_cache";
+    std::filesystem::create_directories(dir);
+
+    // small and wide: one row of tiles that a row-indexed shard choice would put in a single shard
+    auto wide = make_pattern(1280, 128);
+    auto wide_file = (dir / "wide.ppm").string();
+    write_p6(wide_file, wide);
+    std::filesystem::remove(wide_file + ".mip");
+
+    std::cout << "wide image " << wide.width << "x" << wide.height << "\n";
+    {
+        texture_cache cache(size_t(1) << 20);
+        auto image = cache.open(wide_file);
+        check(image && pyramid_matches(cache, *image, wide), "every tile of every level matches the filtered image");
+    }
+    {
+        // image ids 65536 apart: a key that kept only the low 16 id bits would hand the second image the first's tiles
+        auto other = make_pattern(96, 80);
+        std::reverse(other.rgb.begin(), other.rgb.end());
+        auto other_file = (dir / "other.ppm").string();
+        write_p6(other_file, other);
+        std::filesystem::remove(other_file + ".mip");
+
+        texture_cache cache(size_t(1) << 20);
+        auto first = cache.open(wide_file);
+        check(first && pyramid_matches(cache, *first, wide), "first image read");
+        for (int i = 1; i < 65536; i++)
+            cache.open(wide_file);
+        auto second = cache.open(other_file);
+        check(second && second->id() == first->id() + 65536 && pyramid_matches(cache, *second, other),
+              "an image opened 65536 ids later gets its own tiles");
+
+        bool leftover = false;
+        for (const auto& file : std::filesystem::directory_iterator(dir))
+            leftover |= file.path().string().find(".partial") != std::string::npos;
+        check(!leftover, "no partial pyramid files left behind");
+    }
+    {
+        // random full resolution lookups on every core, under a budget that holds the image and all its levels
+        texture_cache cache(size_t(1) << 20);
+        auto image = cache.open(wide_file);
+        int threads = int(std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::thread> pool;
+        for (int i = 0; i < threads; i++)
+            pool.emplace_back([&] {
+                for (int k = 0; k < 200000; k++)
+                    cache.sample(*image, random_double(), random_double(), 0);
+            });
+        for (auto& thread : pool)
+            thread.join();
+
+        auto stats = cache.statistics();
+        std::cout << "  " << stats << "\n";
+        check(stats.evictions == 0, "a budget larger than the image evicts nothing");
+        check(stats.bytes_read <= wide.rgb.size() * uint64_t(threads), "each tile is read about once");
+        check(stats.hit_rate() > 0.99, "hit rate above 99%");
+    }
+
+    // large: far more texels than a small budget holds
+    auto large = make_pattern(2048, 2048);
+    auto large_file = (dir / "large.ppm").string();
+    write_p6(large_file, large);
+    std::filesystem::remove(large_file + ".mip");
+
+    std::cout << "large image " << large.width << "x" << large.height << "\n";
+    {
+        texture_cache cache(size_t(1) << 20);
+        auto image = cache.open(large_file);
+        check(image && pyramid_matches(cache, *image, large), "every tile of every level matches the filtered image");
+        auto stats = cache.statistics();
+        check(stats.resident_bytes <= (size_t(1) << 20), "a full sweep stays within the budget");
+    }
+
+    const size_t budget = size_t(256) << 10;
+    texture_cache::global().set_budget(budget);
+
+    // seen from far away, the sphere is a few pixels across and only coarse levels are read
+    render_textured_sphere(large_file, 400);
+    auto far = texture_cache::global().statistics();
+    std::cout << "far view\n  " << far << "\n";
+    check(far.bytes_read < large.rgb.size() / 16, "coarse levels only: under 1/16 of the image read");
+
+    render_textured_sphere(large_file, 3);
+    auto near = texture_cache::global().statistics();
+    std::cout << "near view (cumulative)\n  " << near << "\n";
+    check(near.resident_bytes <= budget, "resident tiles within the global budget");
+    check(near.hit_rate() > 0.95, "hit rate above 95%");
+
+    return all_passed ? 0 : 1;
+}
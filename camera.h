@@ -5,6 +5,29 @@
 
 #include "hittable.h"
 #include "material.h"
+#include "topology.h"
+
+#include <algorithm>
+#include <latch>
+#include <thread>
+#include <vector>
+
+// Rays scattered at one bounce of a pixel's paths: how many, and the sums of where they left from and their unit directions
+struct scatter_lobe {
+    int rays = 0;
+    vec3 origin_sum = vec3(0,0,0);
+    vec3 direction_sum = vec3(0,0,0);
+};
+
+// What a pixel's paths hit, recorded by camera::sample_pixel on request (see incremental_renderer)
+struct hit_trace {
+    int max_bounce = 3;                             // record up to this many bounces after the camera ray's hit
+    int paths = 0;                                  // camera rays traced
+    std::vector<const hittable*> primary;           // objects hit by camera rays, with repeats
+    std::vector<const hittable*> touched;           // objects each path hit: one entry per path and object
+    std::vector<const hittable*> path;              // the objects of the path being traced
+    std::vector<scatter_lobe> lobes;                // per bounce, 0 being at the camera ray's hit
+};
 
 class camera {
 public:
@@ -22,45 +45,50 @@ public:
     double defocus_angle = 0;                               // Variation angle of rays through each pixel
     double focus_dist = 10;                                 // Distance between camera lookfrom point (camera center) to plane of perfect focus (viewport)
 
+    // parallel rendering: 1 thread keeps the scanline renderer, anything else renders square tiles on worker threads
+    int threads = 1;                                        // number of worker threads: 0 uses every available core
+    int tile_size = 16;                                     // tile edge length in pixels
+    bool numa_aware = false;                                // pin workers to cores, and give each NUMA node its own band of tiles and framebuffer pages
+    int numa_nodes = 0;                                     // number of NUMA nodes to spread over: 0 uses all of them
+    bool replicate_scene = false;                           // NUMA mode only: each node renders from its own node-local copy of the world
+
+    // adds the settings that decide the image (not samples_per_pixel, nor how rendering is spread) to h, like hittable::fingerprint
+    void fingerprint(content_hash& h) const {
+        h.add(aspect_ratio).add(image_width).add(max_depth).add(v_fov).add(lookfrom).add(lookat).add(vup)
+         .add(defocus_angle).add(focus_dist);
+    }
+
     // renders image pixel by pixel
     void render(const hittable& world) {
+        render(world, std::cout);
+    }
+
+    void render(const hittable& world, std::ostream& out) {
         initialize();
 
         // ASCII color type, columns, rows, max color
-        std::cout << "P3\n" << image_width << " " << image_height << "\n255\n";
+        out << "P3\n" << image_width << " " << image_height << "\n255\n";
+
+        if (threads != 1 || numa_aware) {
+            render_parallel(world, out);
+            return;
+        }
 
         // Image Rendering
         for (int row = 0; row < image_height; ++row) {
             // Progress indicator
             std::clog << "\rScanlines Remaining: " << (image_height - row) << " " << std::flush;
             for (int col = 0; col < image_width; ++col) {
-                color pixel_color(0,0,0);
-                // cast multiple rays per pixel, getting a slightly different sample surrounding pixel each time
-                for (int sample = 0; sample < samples_per_pixel; sample++) {
-                    // fire ray, allowing certain number of surface reflections
-                    ray r = get_ray(col, row);
-                    // total the sample rays collected
-                    pixel_color += ray_color(r, max_depth, world);
-                }
                 // divide total sampling by the number of samples
-                write_color(std::cout, pixel_samples_scale * pixel_color);
+                write_color(out, pixel_samples_scale * sample_pixel(col, row, world));
             }
         }
         // enough blank space to clear out previous message
         std::clog << "\rDone.                 \n";
     }
 
-private:
-    int    image_height;         // Rendered image height
-    double pixel_samples_scale;  // Color scale factor for a sum of pixel samples
-    point3 center;               // Camera center
-    point3 pixel00_loc;          // Location of pixel 0, 0
-    vec3   pixel_delta_u;        // Offset to pixel to the right
-    vec3   pixel_delta_v;        // Offset to pixel below
-    vec3   u, v, w;              // Camera frame basis vectors: camera right, camera up, direction of lookat to camera, respectively
-    vec3   defocus_disk_u;       // Defocus disk horizontal radius
-    vec3   defocus_disk_v;       // Defocus disk vertical radius
-
+    // Computes image height and the viewport from the public settings: render() calls this itself,
+    // callers driving sample_pixel directly (e.g. a render service) call it once after changing settings
     void initialize() {
         // Given width and aspect ratio, calculate image height (at least 1)
         image_height = int(image_width / aspect_ratio);
@@ -101,6 +129,157 @@ private:
         defocus_disk_v = v * defocus_radius;
     }
 
+    // total of samples_per_pixel rays through pixel i, j (unscaled)
+    color sample_pixel(int i, int j, const hittable& world) const {
+        return sample_pixel(i, j, world, samples_per_pixel, nullptr);
+    }
+
+    // total of the given number of rays through pixel i, j (unscaled), optionally recording what they hit into trace
+    color sample_pixel(int i, int j, const hittable& world, int samples, hit_trace* trace) const {
+        color pixel_color(0,0,0);
+        // cast multiple rays per pixel, getting a slightly different sample surrounding pixel each time
+        for (int sample = 0; sample < samples; sample++) {
+            // fire ray, allowing certain number of surface reflections
+            ray r = get_ray(i, j);
+            // total the sample rays collected
+            pixel_color += ray_color(r, max_depth, world, trace);
+
+            if (trace) {
+                trace->paths++;
+                std::sort(trace->path.begin(), trace->path.end());
+                auto end = std::unique(trace->path.begin(), trace->path.end());
+                trace->touched.insert(trace->touched.end(), trace->path.begin(), end);
+                trace->path.clear();
+            }
+        }
+        return pixel_color;
+    }
+
+    // Unjittered ray from the lens center through the middle of pixel i, j, reaching the focus plane at t = 1. Its cone
+    // covers the pixel; rays from elsewhere on the lens (see lens_radius) converge onto it at the focus plane.
+    ray pixel_center_ray(int i, int j) const {
+        ray r(center, pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v) - center);
+        r.set_cone(0, std::sqrt(2.0) * pixel_delta_u.length() / focus_dist);
+        return r;
+    }
+
+    double lens_radius() const { return defocus_angle <= 0 ? 0 : defocus_disk_u.length(); }
+
+    int height() const { return image_height; }
+    double sample_scale() const { return pixel_samples_scale; }
+
+private:
+    int    image_height;         // Rendered image height
+    double pixel_samples_scale;  // Color scale factor for a sum of pixel samples
+    point3 center;               // Camera center
+    point3 pixel00_loc;          // Location of pixel 0, 0
+    vec3   pixel_delta_u;        // Offset to pixel to the right
+    vec3   pixel_delta_v;        // Offset to pixel below
+    vec3   u, v, w;              // Camera frame basis vectors: camera right, camera up, direction of lookat to camera, respectively
+    vec3   defocus_disk_u;       // Defocus disk horizontal radius
+    vec3   defocus_disk_v;       // Defocus disk vertical radius
+
+    // One NUMA node's share of the image: a band of rows, its framebuffer, and the workers rendering it
+    struct render_node {
+        int workers = 0;
+        int row_begin = 0, row_end = 0;         // rows [row_begin, row_end) of the image
+        std::vector<color> pixels;              // band framebuffer: allocated and first touched by one of the node's own workers
+        shared_ptr<hittable> replica;           // node-local copy of the world (replicate_scene)
+        std::unique_ptr<std::latch> ready;      // released once pixels (and replica) exist
+        std::atomic<int> next_tile{0};          // tiles are handed out dynamically, but only among this node's workers
+    };
+
+    // Splits the image into one band of rows per NUMA node (sized by its worker count) and renders the bands' tiles on worker threads.
+    // Without numa_aware everything is a single unpinned node, which is plain tiled multithreading.
+    void render_parallel(const hittable& world, std::ostream& out) {
+        cpu_topology topo;
+        if (numa_aware) {
+            topo = cpu_topology::detect();
+            if (numa_nodes > 0 && numa_nodes < int(topo.nodes.size()))
+                topo.nodes.resize(numa_nodes);
+        } else {
+            topo.nodes.emplace_back();
+        }
+
+        int worker_count = threads > 0 ? threads
+                         : numa_aware ? topo.core_count()
+                         : int(std::max(1u, std::thread::hardware_concurrency()));
+
+        // every node used needs at least one worker to render its band
+        if (int(topo.nodes.size()) > worker_count)
+            topo.nodes.resize(worker_count);
+
+        std::vector<render_node> nodes(topo.nodes.size());
+
+        // deal workers out across nodes, so that two workers on a two-socket machine use both sockets
+        std::vector<int> worker_node(worker_count), worker_cpu(worker_count, -1);
+        for (int k = 0; k < worker_count; k++) {
+            int n = k % int(nodes.size());
+            const auto& cpus = topo.nodes[n];
+            worker_node[k] = n;
+            if (numa_aware && !cpus.empty())
+                worker_cpu[k] = cpus[nodes[n].workers % cpus.size()];
+            nodes[n].workers++;
+        }
+
+        // nodes with more workers get proportionally more rows
+        int row = 0;
+        for (size_t n = 0; n < nodes.size(); n++) {
+            auto& node = nodes[n];
+            node.row_begin = row;
+            row += int((long long)image_height * node.workers / worker_count);
+            node.row_end = (n + 1 == nodes.size()) ? image_height : row;
+            row = node.row_end;
+            node.ready = std::make_unique<std::latch>(node.workers);
+        }
+
+        std::vector<std::thread> pool;
+        std::vector<int> local_index(nodes.size(), 0);
+        for (int k = 0; k < worker_count; k++) {
+            auto& node = nodes[worker_node[k]];
+            int index = local_index[worker_node[k]]++;
+            int cpu = worker_cpu[k];
+            pool.emplace_back([this, &node, &world, index, cpu] { render_worker(node, index, cpu, world); });
+        }
+        for (auto& worker : pool)
+            worker.join();
+
+        // bands are in image order, so writing them in turn writes the image top to bottom
+        for (const auto& node : nodes)
+            for (const auto& pixel_color : node.pixels)
+                write_color(out, pixel_samples_scale * pixel_color);
+
+        std::clog << "\rDone.                 \n";
+    }
+
+    void render_worker(render_node& node, int index, int cpu, const hittable& world) const {
+        if (cpu >= 0)
+            pin_thread_to_cpu(cpu);
+
+        // the first worker of each node allocates its memory after pinning, so the kernel's first-touch policy places the pages on that node
+        if (index == 0) {
+            node.pixels.assign(size_t(node.row_end - node.row_begin) * image_width, color(0,0,0));
+            if (numa_aware && replicate_scene)
+                node.replica = world.clone();
+        }
+        node.ready->arrive_and_wait();
+
+        const hittable& scene = node.replica ? *node.replica : world;
+        int tiles_x = (image_width + tile_size - 1) / tile_size;
+        int tiles_y = (node.row_end - node.row_begin + tile_size - 1) / tile_size;
+
+        for (int tile = node.next_tile++; tile < tiles_x * tiles_y; tile = node.next_tile++) {
+            int col_begin = (tile % tiles_x) * tile_size;
+            int row_begin = node.row_begin + (tile / tiles_x) * tile_size;
+            int col_end = std::min(col_begin + tile_size, image_width);
+            int row_end = std::min(row_begin + tile_size, node.row_end);
+
+            for (int row = row_begin; row < row_end; ++row)
+                for (int col = col_begin; col < col_end; ++col)
+                    node.pixels[size_t(row - node.row_begin) * image_width + col] = sample_pixel(col, row, scene);
+        }
+    }
+
     // Construct a camera ray originating from the defocus disk and directed at randomly sample point around the pixel location i, j.
     ray get_ray(int i, int j) const {
         // generates a sample within a square of size -0.5,0.5
@@ -115,8 +294,10 @@ private:
         auto ray_direction = pixel_sample - ray_origin;
         auto ray_time = random_double();
 
-        // cast ray
-        return ray(ray_origin, ray_direction, ray_time);
+        // cast ray: its cone spreads by one pixel's width over the focus distance
+        ray r(ray_origin, ray_direction, ray_time);
+        r.set_cone(0, pixel_delta_u.length() / focus_dist);
+        return r;
     }
 
     // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit square.
@@ -131,7 +312,7 @@ private:
     }
 
     // Given ray position, calculate color of each pixel across screen
-    color ray_color(const ray& r, int depth, const hittable& world) const {
+    color ray_color(const ray& r, int depth, const hittable& world, hit_trace* trace = nullptr) const {
         // If we've exceeded the ray bounce limit, no more light is gathered.
         if (depth <= 0)
             return color(0,0,0);
@@ -140,12 +321,31 @@ private:
 
         // for given hittable, if hit (according to what hittable is), reflect ray randomly and return what color is kept by recursive reflection
         if (world.hit(r, interval(0.001, infinity), rec)) {
+            int bounce = max_depth - depth;
+            bool traced = trace && bounce <= trace->max_bounce;
+            if (traced) {
+                trace->path.push_back(rec.object);
+                if (bounce == 0)
+                    trace->primary.push_back(rec.object);
+            }
+
             ray scattered;
             color attenuation;
             // returns using different behaviors depending on material
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
+            if (rec.mat->scatter(r, rec, attenuation, scattered)) {
+                // scattered rays carry on the incoming cone (exact for mirrors, an underestimate for rough surfaces)
+                scattered.set_cone(r.width_at(rec.t), r.spread());
+                if (traced) {
+                    if (int(trace->lobes.size()) <= bounce)
+                        trace->lobes.resize(bounce + 1);
+                    auto& lobe = trace->lobes[bounce];
+                    lobe.rays++;
+                    lobe.origin_sum += rec.p;
+                    lobe.direction_sum += unit_vector(scattered.direction());
+                }
                 // depth # of times, fire ray from hittable (previous hit point) in direction (from hemisphere) according to material
-                return attenuation * ray_color(scattered, depth-1, world);
+                return attenuation * ray_color(scattered, depth-1, world, trace);
+            }
             return color(0,0,0);
         }
 
@@ -26,4 +26,12 @@ void write_color(std::ostream& out, const color& pixel_color) {
     out << r_byte << " " << g_byte << " " << b_byte << "\n";
 }
 
+// same conversion as write_color, written as three raw bytes for binary (P6) PPM output
+inline void write_color_binary(std::ostream& out, const color& pixel_color) {
+    interval intensity(0.000, 0.999);
+    out.put(char(int(256 * intensity.clamp(linear_to_gamma(pixel_color.x())))));
+    out.put(char(int(256 * intensity.clamp(linear_to_gamma(pixel_color.y())))));
+    out.put(char(int(256 * intensity.clamp(linear_to_gamma(pixel_color.z())))));
+}
+
 #endif //COLOR_H
\ No newline at end of file
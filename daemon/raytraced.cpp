@@ -0,0 +1,141 @@
+// Render daemon: builds every scene once, then serves render jobs over a local Unix socket until killed.
+// usage: raytraced [socket_path] [threads] [max_pixels] [max_samples]
+//
+// Protocol (one request per line, any number of requests per connection):
+//   scenes                       -> "scene <name>" lines, then "end"
+//   render scene=<name> k=v ...  -> "job <id>", the image as "data <bytes>" chunks, then
+//                                   "done queue_ms=... render_ms=... total_ms=... msamples_per_s=..."
+//   anything invalid             -> "error <message>"
+// See render_service::submit for the render keys.
+
+#include "rtweekend.h"
+
+#include "render_service.h"
+#include "scenes.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// writes all of data, false once the client has gone
+bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += size_t(n);
+    }
+    return true;
+}
+
+// reads one '\n' terminated line (without the newline), false at end of stream
+bool read_line(int fd, std::string& buffer, std::string& line) {
+    while (true) {
+        auto newline = buffer.find('\n');
+        if (newline != std::string::npos) {
+            line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return true;
+        }
+        char chunk[1024];
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            return false;
+        buffer.append(chunk, size_t(n));
+    }
+}
+
+void serve_render(int fd, render_service& service, const std::string& request) {
+    shared_ptr<render_job> job;
+    try {
+        job = service.submit(request);
+    } catch (const std::exception& e) {
+        send_all(fd, std::string("error ") + e.what() + "\n");
+        return;
+    }
+
+    if (!send_all(fd, "job " + std::to_string(job->id) + "\n")) {
+        service.cancel(*job);
+        return;
+    }
+
+    bool delivered = service.stream(*job, [fd](const std::string& chunk) {
+        return send_all(fd, "data " + std::to_string(chunk.size()) + "\n") && send_all(fd, chunk);
+    });
+
+    auto m = job->metrics();
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(2)
+         << "queue_ms=" << m.queue_ms << " render_ms=" << m.render_ms << " total_ms=" << m.total_ms
+         << " msamples_per_s=" << (m.render_ms > 0 ? m.samples / (m.render_ms * 1e3) : 0);
+
+    std::clog << "job " << job->id << " (priority " << job->priority << ", "
+              << job->cam.image_width << "x" << job->cam.height() << ", " << job->cam.samples_per_pixel << " spp) "
+              << (delivered ? "" : "cancelled ") << line.str() << "\n";
+    if (delivered)
+        send_all(fd, "done " + line.str() + "\n");
+}
+
+void serve_client(int fd, render_service& service) {
+    std::string buffer, line;
+    while (read_line(fd, buffer, line)) {
+        if (line.empty())
+            continue;
+
+        if (line == "scenes") {
+            std::string reply;
+            for (const auto& name : service.scene_names())
+                reply += "scene " + name + "\n";
+            if (!send_all(fd, reply + "end\n"))
+                break;
+        } else if (line.rfind("render", 0) == 0) {
+            serve_render(fd, service, line.substr(6));
+        } else {
+            if (!send_all(fd, "error unknown command\n"))
+                break;
+        }
+    }
+    close(fd);
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "/tmp/raytrace.sock";
+    int threads = argc > 2 ? std::stoi(argv[2]) : 0;
+
+    render_service service(threads);
+    if (argc > 3) service.max_pixels = std::stoll(argv[3]);
+    if (argc > 4) service.max_samples = std::stoll(argv[4]);
+    for (const auto& [name, build] : scene_catalog()) {
+        std::clog << "building scene " << name << "\n";
+        service.add_scene(name, build);
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (server < 0 || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "raytraced: cannot create socket " << path << "\n";
+        return 1;
+    }
+    path.copy(addr.sun_path, path.size());
+    unlink(path.c_str());
+
+    if (bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(server, 16) < 0) {
+        std::perror(("raytraced: " + path).c_str());
+        return 1;
+    }
+    std::clog << "listening on " << path << "\n";
+
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        std::thread(serve_client, client, std::ref(service)).detach();
+    }
+}
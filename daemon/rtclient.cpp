@@ -0,0 +1,108 @@
+// Sends one render request to raytraced, writes the image to stdout and the job's metrics to stderr.
+// usage: rtclient <socket_path> scene=<name> [key=value ...]
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// buffered reader over the socket
+class connection {
+public:
+    explicit connection(int fd) : fd(fd) {}
+
+    bool read_line(std::string& line) {
+        line.clear();
+        char c;
+        while (read_bytes(&c, 1)) {
+            if (c == '\n')
+                return true;
+            line += c;
+        }
+        return false;
+    }
+
+    bool read_bytes(char* out, size_t count) {
+        while (count > 0) {
+            if (pos == end) {
+                ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                    return false;
+                pos = 0;
+                end = size_t(n);
+            }
+            size_t take = std::min(count, end - pos);
+            std::copy(buffer + pos, buffer + pos + take, out);
+            pos += take;
+            out += take;
+            count -= take;
+        }
+        return true;
+    }
+
+private:
+    int fd;
+    char buffer[1 << 16];
+    size_t pos = 0, end = 0;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: rtclient <socket_path> scene=<name> [key=value ...]\n";
+        return 2;
+    }
+
+    std::string path = argv[1];
+    std::string request = "render";
+    for (int i = 2; i < argc; i++)
+        request += std::string(" ") + argv[i];
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (fd < 0 || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "rtclient: cannot create socket " << path << "\n";
+        return 1;
+    }
+    path.copy(addr.sun_path, path.size());
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::perror(("rtclient: " + path).c_str());
+        return 1;
+    }
+
+    request += "\n";
+    if (::send(fd, request.data(), request.size(), 0) != ssize_t(request.size())) {
+        std::perror("rtclient: send");
+        return 1;
+    }
+
+    connection conn(fd);
+    std::string line;
+    std::string chunk;
+    while (conn.read_line(line)) {
+        if (line.rfind("data ", 0) == 0) {
+            chunk.resize(std::stoul(line.substr(5)));
+            if (!conn.read_bytes(chunk.data(), chunk.size()))
+                break;
+            std::cout.write(chunk.data(), chunk.size());
+            std::cout.flush();
+        } else if (line.rfind("done ", 0) == 0) {
+            std::cerr << line.substr(5) << "\n";
+            close(fd);
+            return 0;
+        } else if (line.rfind("error ", 0) == 0) {
+            std::cerr << "rtclient: " << line.substr(6) << "\n";
+            close(fd);
+            return 1;
+        }
+        // "job <id>" needs no action
+    }
+
+    std::cerr << "rtclient: connection closed before the job finished\n";
+    close(fd);
+    return 1;
+}
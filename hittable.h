@@ -2,6 +2,7 @@
 #define HITTABLE_H
 
 class material;
+class hittable;
 
 // Bundle of data per ray intersection, so bunches of arguments don't need to be passed
 class hit_record {
@@ -9,6 +10,7 @@ public:
     point3 p;
     vec3 normal;
     shared_ptr<material> mat;       // points to whatever material the hittable that is hit has
+    const hittable* object;         // the innermost hittable that was hit (not the list containing it)
     double t;
     bool front_face;
 
@@ -29,6 +31,18 @@ public:
 
     // calculates ray intersections within valid t values
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+    // deep copy (materials included), allocated by the calling thread: used to replicate read-only scenes per NUMA node
+    virtual shared_ptr<hittable> clone() const = 0;
+
+    // Surface coordinates (u,v) of rec's hit point, and the ray's footprint there in (u,v) units. Computed on demand by
+    // materials whose texture needs them, rather than for every candidate hit. rec.object is the hittable to ask.
+    virtual void surface_coordinates(const ray& r, const hit_record& rec, double& u, double& v, double& uv_width) const {
+        u = v = uv_width = 0;
+    }
+
+    // adds everything that decides how the hittable renders (geometry and materials) to h, e.g. to key cached renders
+    virtual void fingerprint(content_hash& h) const = 0;
 };
 
 #endif //HITTABLE_H
\ No newline at end of file
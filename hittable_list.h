@@ -39,6 +39,20 @@ public:
 
         return hit_anything;
     }
+
+    void fingerprint(content_hash& h) const override {
+        h.add(std::string("hittable_list")).add(objects.size());
+        for (const auto& object : objects)
+            object->fingerprint(h);
+    }
+
+    shared_ptr<hittable> clone() const override {
+        auto copy = make_shared<hittable_list>();
+        copy->objects.reserve(objects.size());
+        for (const auto& object : objects)
+            copy->add(object->clone());
+        return copy;
+    }
 };
 
 #endif //HITTABLE_LIST_H
\ No newline at end of file
@@ -0,0 +1,266 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Progressive renderer for look-dev: keeps every pixel's accumulated samples, which objects its paths hit in their
+// first few bounces, and where and in which directions they scattered at each of those bounces. After a scene edit,
+// only the pixels the edit can affect are thrown away and sampled again; every other pixel keeps its samples, and can
+// go on converging from them.
+//
+// A pixel depends on an object when its camera rays hit it, or when more than min_path_fraction of its paths hit it
+// within trace_bounces bounces: counted from the recorded hits, and estimated from the recorded scattering (as a cone
+// around each bounce's mean direction, from its mean origin), which also covers where a moved object arrives and the
+// small shares a few paths per pixel count unreliably. Pixels below the fraction keep their samples, an error of about
+// that fraction of the light they gather through the edited object; later bounces are not tracked.
+class incremental_renderer {
+public:
+    int trace_bounces = 3;              // bounces after the camera ray's hit whose objects are recorded
+    double min_path_fraction = 0.02;    // share of a pixel's paths an edited object must meet to invalidate the pixel
+
+    // world is kept by reference and edited through this class; cam's samples_per_pixel is the per-pixel target
+    incremental_renderer(hittable_list& world, const camera& cam) : world(world), cam(cam) {
+        this->cam.initialize();
+        pixels.resize(size_t(cam.image_width) * this->cam.height());
+    }
+
+    // Samples every pixel up to samples_per_pixel: the whole image the first time, only invalidated pixels after an
+    // edit. Runs on cam.threads threads (0: every core). Returns the number of pixels that needed samples.
+    int converge() {
+        int target = cam.samples_per_pixel;
+        int worker_count = cam.threads > 0 ? cam.threads : int(std::max(1u, std::thread::hardware_concurrency()));
+        std::atomic<int> next_row{0}, sampled{0};
+
+        auto worker = [&] {
+            for (int row = next_row++; row < cam.height(); row = next_row++) {
+                for (int col = 0; col < cam.image_width; col++) {
+                    auto& pixel = pixels[size_t(row) * cam.image_width + col];
+                    if (pixel.samples >= target)
+                        continue;
+
+                    hit_trace trace;
+                    trace.max_bounce = trace_bounces;
+                    pixel.sum += cam.sample_pixel(col, row, world, target - pixel.samples, &trace);
+                    pixel.samples = target;
+                    record(pixel, trace);
+                    sampled++;
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (int i = 1; i < worker_count; i++)
+            pool.emplace_back(worker);
+        worker();
+        for (auto& thread : pool)
+            thread.join();
+
+        return sampled;
+    }
+
+    // raises the per-pixel target by extra samples and converges every pixel to it
+    int refine(int extra) {
+        cam.samples_per_pixel += extra;
+        return converge();
+    }
+
+    // Scene edits: each one invalidates the pixels it can affect, and returns how many. Call converge() afterwards.
+    int move_sphere(sphere& s, const point3& new_center) {
+        auto old_bounds = bounds(s);
+        s.set_center(new_center);
+        auto new_bounds = bounds(s);
+
+        return invalidate([&](const pixel_state& pixel, const ray& center_ray) {
+            // where the sphere was, and where it is now: camera rays that may hit it, or scattered rays it may
+            // intercept (so that it is reflected, seen through glass, or casts a shadow)
+            return depends_on(pixel, &s, old_bounds)
+                || bundle_meets_sphere(center_ray, cam.lens_radius(), new_bounds.center, new_bounds.radius)
+                || pixel.fraction_towards(new_bounds.center, new_bounds.radius) > min_path_fraction;
+        });
+    }
+
+    int set_material(sphere& s, shared_ptr<material> mat) {
+        s.set_material(mat);
+        auto b = bounds(s);
+        return invalidate([&](const pixel_state& pixel, const ray&) { return depends_on(pixel, &s, b); });
+    }
+
+    // for materials changed in place: invalidates every pixel that depends on a sphere of the world using mat
+    int material_changed(const material& mat) {
+        std::vector<std::pair<const sphere*, sphere_bounds>> users;
+        for (const auto& object : world.objects) {
+            auto s = dynamic_cast<const sphere*>(object.get());
+            if (s && s->get_material().get() == &mat)
+                users.emplace_back(s, bounds(*s));
+        }
+        return invalidate([&](const pixel_state& pixel, const ray&) {
+            for (const auto& [s, b] : users)
+                if (depends_on(pixel, s, b))
+                    return true;
+            return false;
+        });
+    }
+
+    // the pixel's current average, and the samples it holds
+    color pixel_color(int col, int row) const {
+        const auto& pixel = pixels[size_t(row) * cam.image_width + col];
+        return pixel.samples > 0 ? pixel.sum / pixel.samples : color(0,0,0);
+    }
+    int pixel_samples(int col, int row) const { return pixels[size_t(row) * cam.image_width + col].samples; }
+
+    // pixels currently short of samples_per_pixel
+    int dirty_pixels() const {
+        int count = 0;
+        for (const auto& pixel : pixels)
+            count += (pixel.samples < cam.samples_per_pixel);
+        return count;
+    }
+
+    // writes the current image as PPM, each pixel averaged over however many samples it holds
+    void write(std::ostream& out) const {
+        out << "P3\n" << cam.image_width << " " << cam.height() << "\n255\n";
+        for (int row = 0; row < cam.height(); row++)
+            for (int col = 0; col < cam.image_width; col++)
+                write_color(out, pixel_color(col, row));
+    }
+
+private:
+    struct pixel_state {
+        color sum;
+        int samples = 0;
+        std::vector<const hittable*> primary;                   // objects hit by camera rays: sorted, unique
+        std::vector<std::pair<const hittable*, int>> touched;   // paths that hit each object, sorted by object
+        int paths = 0;
+        std::vector<scatter_lobe> lobes;                        // per bounce
+
+        // camera rays hit the object, or more than min_fraction of the paths did
+        bool recorded(const hittable* object, double min_fraction) const {
+            if (std::binary_search(primary.begin(), primary.end(), object))
+                return true;
+            auto found = std::lower_bound(touched.begin(), touched.end(), std::make_pair(object, 0));
+            return found != touched.end() && found->first == object && found->second > min_fraction * paths;
+        }
+
+        // Upper estimate of the share of paths that would hit a sphere within the recorded bounces: the sum over bounces
+        // of the share of paths scattering there, times the share of their rays the sphere intercepts. Rays are taken to
+        // leave from their mean origin and spread evenly over a cone around their mean direction, as wide as gives the
+        // same mean length (a cosine lobe gives 2/3, a mirror 1); the sphere intercepts at most its solid angle of it.
+        double fraction_towards(const point3& center, double radius) const {
+            double fraction = 0;
+            for (const auto& lobe : lobes) {
+                if (lobe.rays == 0)
+                    continue;
+                vec3 to_center = center - lobe.origin_sum / lobe.rays;
+                double distance = to_center.length();
+                double share = double(lobe.rays) / paths;
+                if (distance <= radius) {
+                    fraction += share;
+                    continue;
+                }
+
+                vec3 mean = lobe.direction_sum / lobe.rays;
+                double spread = std::acos(std::clamp(2 * mean.length() - 1, -1.0, 1.0));       // cone half-angle
+                double size = std::asin(radius / distance);                                     // sphere's angular radius
+                double apart = mean.length() > 1e-9
+                             ? std::acos(std::clamp(dot(mean, to_center) / (mean.length() * distance), -1.0, 1.0)) : 0;
+                if (apart >= spread + size)
+                    continue;
+
+                double cone = 2 * pi * (1 - std::cos(spread)), disk = 2 * pi * (1 - std::cos(size));
+                fraction += share * (cone <= disk ? 1 : disk / cone);
+            }
+            return fraction;
+        }
+    };
+
+    hittable_list& world;
+    camera cam;
+    std::vector<pixel_state> pixels;
+
+    static void record(pixel_state& pixel, hit_trace& trace) {
+        pixel.primary.insert(pixel.primary.end(), trace.primary.begin(), trace.primary.end());
+        std::sort(pixel.primary.begin(), pixel.primary.end());
+        pixel.primary.erase(std::unique(pixel.primary.begin(), pixel.primary.end()), pixel.primary.end());
+
+        std::sort(trace.touched.begin(), trace.touched.end());
+        for (size_t i = 0; i < trace.touched.size(); ) {
+            size_t end = i;
+            while (end < trace.touched.size() && trace.touched[end] == trace.touched[i])
+                end++;
+            auto found = std::lower_bound(pixel.touched.begin(), pixel.touched.end(), std::make_pair(trace.touched[i], 0));
+            if (found != pixel.touched.end() && found->first == trace.touched[i])
+                found->second += int(end - i);
+            else
+                pixel.touched.insert(found, {trace.touched[i], int(end - i)});
+            i = end;
+        }
+        pixel.paths += trace.paths;
+
+        if (pixel.lobes.size() < trace.lobes.size())
+            pixel.lobes.resize(trace.lobes.size());
+        for (size_t i = 0; i < trace.lobes.size(); i++) {
+            pixel.lobes[i].rays += trace.lobes[i].rays;
+            pixel.lobes[i].origin_sum += trace.lobes[i].origin_sum;
+            pixel.lobes[i].direction_sum += trace.lobes[i].direction_sum;
+        }
+    }
+
+    // throws away the samples and dependencies of every pixel for which affected(pixel, pixel center ray) holds
+    template <typename predicate>
+    int invalidate(predicate affected) {
+        int count = 0;
+        for (int row = 0; row < cam.height(); row++) {
+            for (int col = 0; col < cam.image_width; col++) {
+                auto& pixel = pixels[size_t(row) * cam.image_width + col];
+                if (pixel.samples > 0 && affected(pixel, cam.pixel_center_ray(col, row))) {
+                    pixel = pixel_state();
+                    count++;
+                }
+            }
+        }
+        return count;
+    }
+
+    struct sphere_bounds {
+        point3 center;
+        double radius;
+    };
+
+    // sphere enclosing s over the whole shutter interval (time 0 to 1)
+    static sphere_bounds bounds(const sphere& s) {
+        auto start = s.center_at(0), end = s.center_at(1);
+        return { 0.5 * (start + end), s.get_radius() + 0.5 * (end - start).length() };
+    }
+
+    // whether the pixel depends on an object within b, from its recorded hits or its estimated share of paths reaching b
+    bool depends_on(const pixel_state& pixel, const hittable* object, const sphere_bounds& b) const {
+        return pixel.recorded(object, min_path_fraction) || pixel.fraction_towards(b.center, b.radius) > min_path_fraction;
+    }
+
+    // Whether any camera ray through r's pixel may pass within radius of center. The rays leave a lens of lens_radius
+    // around r's origin and converge onto r's cone at the focus plane (t = 1), so the bundle's radius at t is
+    // lens_radius * |1 - t| plus half the cone's width; it is taken at its widest over the t the sphere spans.
+    static bool bundle_meets_sphere(const ray& r, double lens_radius, const point3& center, double radius) {
+        double length = r.direction().length();
+        vec3 dir = r.direction() / length;
+        vec3 oc = center - r.origin();
+        double along = dot(oc, dir);
+        if (along < -radius)
+            return false;
+        double distance = (oc - along * dir).length();
+
+        auto bundle_radius = [&](double t) { return lens_radius * std::fabs(1 - t) + 0.5 * r.width_at(t); };
+        double t_near = std::max(0.0, along - radius) / length, t_far = (along + radius) / length;
+        return distance < radius + std::max(bundle_radius(t_near), bundle_radius(t_far));
+    }
+};
+
+#endif //INCREMENTAL_H
@@ -3,6 +3,8 @@
 
 #include "rtweekend.h"
 
+#include "texture.h"
+
 class hit_record;
 
 // abstract class that encapsulates unique behaviors
@@ -14,6 +16,25 @@ class material {
     virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const {
         return false;
     }
+
+    // copy of this material, allocated by the calling thread (see hittable::clone)
+    virtual shared_ptr<material> clone() const {
+        return make_shared<material>(*this);
+    }
+
+    // adds the material's kind and parameters to h (see hittable::fingerprint)
+    virtual void fingerprint(content_hash& h) const {
+        h.add(std::string("material"));
+    }
+
+  protected:
+    // tex's color at the hit point: surface coordinates are only computed for textures that vary over the surface
+    static color texture_value(const texture& tex, const ray& r_in, const hit_record& rec) {
+        double u = 0, v = 0, uv_width = 0;
+        if (!tex.uniform())
+            rec.object->surface_coordinates(r_in, rec, u, v, uv_width);
+        return tex.value(u, v, rec.p, uv_width);
+    }
 };
 
 // Labert diffuse material: always scattering and attenuating light (reflected rays)
@@ -21,7 +42,8 @@ class material {
 // albedo: fraction of how much light is diffusely reflected
 class lambertian : public material {
   public:
-    lambertian(const color& albedo) : albedo(albedo) {}
+    lambertian(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
+    lambertian(shared_ptr<texture> tex) : tex(tex) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
         auto scatter_direction = rec.normal + random_unit_vector();
@@ -32,29 +54,52 @@ class lambertian : public material {
         }
 
         scattered = ray(rec.p, scatter_direction, r_in.time());
-        attenuation = albedo;       // how light or dark material is: essentially material color
+        attenuation = texture_value(*tex, r_in, rec);       // how light or dark material is: essentially material color
         return true;
     }
 
+    shared_ptr<material> clone() const override {
+        auto copy = make_shared<lambertian>(*this);
+        copy->tex = tex->clone();
+        return copy;
+    }
+
+    void fingerprint(content_hash& h) const override {
+        h.add(std::string("lambertian"));
+        tex->fingerprint(h);
+    }
+
   private:
-    color albedo;
+    shared_ptr<texture> tex;
 };
 
 class metal : public material {
   public:
-    metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+    metal(const color& albedo, double fuzz) : metal(make_shared<solid_color>(albedo), fuzz) {}
+    metal(shared_ptr<texture> tex, double fuzz) : tex(tex), fuzz(fuzz < 1 ? fuzz : 1) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
         vec3 reflected = reflect(r_in.direction(), rec.normal);             // instead of random reflection angle, exacting reflection
         reflected = unit_vector(reflected) + (fuzz * random_unit_vector());    // offset endpoint of reflection by fuzz amount, accounting for (normalizing) reflection distance
 
         scattered = ray(rec.p, reflected, r_in.time());
-        attenuation = albedo;                                                     // how light or dark material is: essentially material color
+        attenuation = texture_value(*tex, r_in, rec);              // how light or dark material is: essentially material color
         return (dot(scattered.direction(), rec.normal) > 0);                // returns true if reflection is away from object (absorbs scattering below surface)
     }
 
+    shared_ptr<material> clone() const override {
+        auto copy = make_shared<metal>(*this);
+        copy->tex = tex->clone();
+        return copy;
+    }
+
+    void fingerprint(content_hash& h) const override {
+        h.add(std::string("metal")).add(fuzz);
+        tex->fingerprint(h);
+    }
+
   private:
-    color albedo;
+    shared_ptr<texture> tex;
     double fuzz;
 };
 
@@ -86,6 +131,14 @@ public:
         return true;
     }
 
+    shared_ptr<material> clone() const override {
+        return make_shared<dielectric>(*this);
+    }
+
+    void fingerprint(content_hash& h) const override {
+        h.add(std::string("dielectric")).add(refraction_index);
+    }
+
 private:
     // Refractive index in vacuum or air, or the ratio of the material's refractive index over the refractive index of the enclosing media
     double refraction_index;
@@ -94,7 +147,11 @@ private:
     static double reflectance(double cosine, double refraction_index) {
         auto r0 = (1 - refraction_index) / (1 + refraction_index);
         r0 = r0*r0;
+#ifdef RT_FAST_MATH
+        return r0 + (1-r0)*fast_pow5(1 - cosine);
+#else
         return r0 + (1-r0)*pow((1 - cosine),5);
+#endif
     }
 };
 
@@ -16,6 +16,16 @@ public:
     vec3 direction() const { return dir; }
     double time() const { return tm; }
 
+    // Ray cone: an isotropic stand-in for ray differentials, used to choose texture filter widths.
+    // width is the footprint diameter at the origin, spread how much it grows per unit of distance travelled.
+    void set_cone(double width, double spread) { cone_width = width; cone_spread = spread; }
+    double spread() const { return cone_spread; }
+
+    // footprint diameter at P(t)
+    double width_at(double t) const {
+        return cone_width + cone_spread * t * dir.length();
+    }
+
     // P(t) = A + tb, where P is a point t distance away from origin point A (direction b)
     point3 at(double t) const {
         return orig + t*dir;
@@ -25,6 +35,8 @@ private:
     point3 orig;
     vec3 dir;
     double tm;
+    double cone_width = 0;
+    double cone_spread = 0;
 };
 
 #endif //RAY_H
\ No newline at end of file
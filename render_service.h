@@ -0,0 +1,363 @@
+#ifndef RENDER_SERVICE_H
+#define RENDER_SERVICE_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A scene kept resident by the service: built once, then rendered by any number of jobs
+struct resident_scene {
+    hittable_list world;
+    camera defaults;            // camera settings chosen by the scene builder: jobs override individual fields
+};
+
+// Latency of one job, in milliseconds
+struct job_metrics {
+    double queue_ms = 0;        // submission until the first tile started rendering
+    double render_ms = 0;       // first tile started until the last tile finished
+    double total_ms = 0;        // submission until the last tile finished (until now, while tiles are left)
+    long long samples = 0;      // rays cast from the camera
+};
+
+// One render: its settings, framebuffer and progress. Created by render_service::submit.
+class render_job {
+public:
+    using clock = std::chrono::steady_clock;
+
+    int id = 0;
+    int priority = 0;           // higher runs first; equal priorities run in submission order
+    bool binary = false;        // P6 instead of P3 output
+    camera cam;                 // the scene's camera with the job's overrides, already initialized
+    const hittable* world = nullptr;
+
+    job_metrics metrics() const {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        auto ms = [](clock::time_point from, clock::time_point to) {
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        };
+        auto end = finished ? finish_time : clock::now();
+
+        job_metrics m;
+        m.queue_ms = started ? ms(submit_time, start_time) : ms(submit_time, end);
+        m.render_ms = started ? ms(start_time, end) : 0;
+        m.total_ms = ms(submit_time, end);
+        m.samples = (long long)cam.image_width * cam.height() * cam.samples_per_pixel;
+        return m;
+    }
+
+private:
+    friend class render_service;
+
+    std::vector<color> pixels;
+    int tiles_x = 0, tiles_y = 0;
+    int next_tile = 0;                      // guarded by the service's queue mutex
+    std::atomic<bool> cancelled{false};     // remaining tiles are skipped once the client has gone
+
+    mutable std::mutex progress_mutex;
+    std::condition_variable progress;
+    std::vector<int> tiles_left;            // per row of tiles
+    int rows_ready = 0;                     // rows [0, rows_ready) are final
+    bool started = false, finished = false;
+    clock::time_point submit_time, start_time, finish_time;
+};
+
+// Long-running renderer: keeps scenes resident, and renders submitted jobs tile by tile on one shared thread pool,
+// always taking the next tile from the highest priority job so that a small urgent job overtakes a large one.
+class render_service {
+public:
+    // Per-job limits, so that one request can't exhaust the daemon's memory or occupy it for days: jobs above them are
+    // rejected by submit. The framebuffer takes sizeof(color) (24) bytes per pixel.
+    long long max_pixels = 16LL << 20;              // image_width * image height
+    long long max_samples = 16LL << 30;             // pixels * samples_per_pixel
+    int max_depth = 1000;
+
+    explicit render_service(int threads = 0) {
+        int count = threads > 0 ? threads : int(std::max(1u, std::thread::hardware_concurrency()));
+        for (int i = 0; i < count; i++)
+            pool.emplace_back([this] { worker_loop(); });
+    }
+
+    ~render_service() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        work_ready.notify_all();
+        for (auto& worker : pool)
+            worker.join();
+    }
+
+    // builds a scene once; jobs name it in their request
+    void add_scene(const std::string& name, void (*build)(hittable_list& world, camera& cam)) {
+        auto scene = std::make_unique<resident_scene>();
+        build(scene->world, scene->defaults);
+        scenes[name] = std::move(scene);
+    }
+
+    std::vector<std::string> scene_names() const {
+        std::vector<std::string> names;
+        for (const auto& [name, scene] : scenes)
+            names.push_back(name);
+        return names;
+    }
+
+    // Parses a request of space separated key=value pairs and queues it. Keys are the camera's own field names
+    // (image_width, aspect_ratio, samples_per_pixel, max_depth, v_fov, lookfrom, lookat, vup, defocus_angle, focus_dist,
+    // tile_size), plus scene (required), format (ppm or ppm-binary) and priority. Vectors are written x,y,z.
+    // Throws std::invalid_argument for malformed requests, and for requests above the service's limits.
+    shared_ptr<render_job> submit(const std::string& request) {
+        auto job = make_shared<render_job>();
+        job->submit_time = render_job::clock::now();
+
+        const resident_scene* scene = nullptr;
+        std::istringstream fields(request);
+        std::string field;
+        std::vector<std::pair<std::string, std::string>> settings;
+        while (fields >> field) {
+            auto eq = field.find('=');
+            if (eq == std::string::npos)
+                throw std::invalid_argument("expected key=value, got '" + field + "'");
+            settings.emplace_back(field.substr(0, eq), field.substr(eq + 1));
+            if (settings.back().first == "scene") {
+                auto found = scenes.find(settings.back().second);
+                if (found == scenes.end())
+                    throw std::invalid_argument("unknown scene '" + settings.back().second + "'");
+                scene = found->second.get();
+            }
+        }
+        if (!scene)
+            throw std::invalid_argument("no scene given");
+
+        job->world = &scene->world;
+        job->cam = scene->defaults;
+        for (const auto& [key, value] : settings)
+            apply_setting(*job, key, value);
+
+        auto& cam = job->cam;
+        if (cam.image_width < 1 || cam.samples_per_pixel < 1 || cam.max_depth < 1 || cam.tile_size < 1)
+            throw std::invalid_argument("image_width, samples_per_pixel, max_depth and tile_size must be positive");
+        // written as negations so that NaN fails them too
+        if (!(std::isfinite(cam.aspect_ratio) && cam.aspect_ratio > 0) || !(std::isfinite(cam.focus_dist) && cam.focus_dist > 0))
+            throw std::invalid_argument("aspect_ratio and focus_dist must be finite and positive");
+        if (!(cam.v_fov > 0 && cam.v_fov < 180) || !(std::isfinite(cam.defocus_angle) && cam.defocus_angle >= 0))
+            throw std::invalid_argument("v_fov must be between 0 and 180 degrees, and defocus_angle finite and not negative");
+        for (const vec3& v : { cam.lookfrom, cam.lookat, cam.vup })
+            if (!std::isfinite(v.x()) || !std::isfinite(v.y()) || !std::isfinite(v.z()))
+                throw std::invalid_argument("lookfrom, lookat and vup must be finite");
+
+        // checked before initialize(), whose int image height would overflow for extreme aspect ratios
+        double pixels = double(cam.image_width) * std::max(1.0, std::floor(cam.image_width / cam.aspect_ratio));
+        if (pixels > double(max_pixels))
+            throw std::invalid_argument("image is above the limit of " + std::to_string(max_pixels) + " pixels");
+        if (pixels * cam.samples_per_pixel > double(max_samples))
+            throw std::invalid_argument("job is above the limit of " + std::to_string(max_samples) + " samples");
+        if (cam.max_depth > max_depth)
+            throw std::invalid_argument("max_depth is above the limit of " + std::to_string(max_depth));
+
+        cam.initialize();
+        job->pixels.assign(size_t(cam.image_width) * cam.height(), color(0,0,0));
+        job->tiles_x = (cam.image_width + cam.tile_size - 1) / cam.tile_size;
+        job->tiles_y = (cam.height() + cam.tile_size - 1) / cam.tile_size;
+        job->tiles_left.assign(job->tiles_y, job->tiles_x);
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            job->id = ++last_job_id;
+            queue[{job->priority, job->id}] = job;
+        }
+        work_ready.notify_all();
+        return job;
+    }
+
+    // Writes the finished image through send as rows complete, top to bottom: the PPM header first, then one chunk per
+    // batch of finished rows. Returns false, and cancels the rest of the job, as soon as send fails.
+    bool stream(render_job& job, const std::function<bool(const std::string&)>& send) {
+        const auto& cam = job.cam;
+        std::ostringstream header;
+        header << (job.binary ? "P6" : "P3") << "\n" << cam.image_width << " " << cam.height() << "\n255\n";
+        if (!send(header.str())) {
+            cancel(job);
+            return false;
+        }
+
+        int sent = 0;
+        while (sent < cam.height()) {
+            int ready;
+            {
+                std::unique_lock<std::mutex> lock(job.progress_mutex);
+                job.progress.wait(lock, [&] { return job.rows_ready > sent; });
+                ready = job.rows_ready;
+            }
+
+            std::ostringstream chunk;
+            for (size_t i = size_t(sent) * cam.image_width; i < size_t(ready) * cam.image_width; i++) {
+                if (job.binary)
+                    write_color_binary(chunk, cam.sample_scale() * job.pixels[i]);
+                else
+                    write_color(chunk, cam.sample_scale() * job.pixels[i]);
+            }
+            if (!send(chunk.str())) {
+                cancel(job);
+                return false;
+            }
+            sent = ready;
+        }
+        return true;
+    }
+
+    // drops the job's queued tiles; tiles already being rendered still finish
+    void cancel(render_job& job) {
+        job.cancelled = true;
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.erase({job.priority, job.id});
+    }
+
+private:
+    std::map<std::string, std::unique_ptr<resident_scene>> scenes;
+
+    std::mutex queue_mutex;
+    std::condition_variable work_ready;
+    // (priority, id) ordered highest priority first, then oldest
+    struct queue_order {
+        bool operator()(const std::pair<int, int>& a, const std::pair<int, int>& b) const {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        }
+    };
+    std::map<std::pair<int, int>, shared_ptr<render_job>, queue_order> queue;     // jobs with tiles left to hand out
+    int last_job_id = 0;
+    bool stopping = false;
+    std::vector<std::thread> pool;
+
+    static vec3 parse_vec3(const std::string& key, const std::string& value) {
+        vec3 v;
+        std::istringstream parts(value);
+        std::string part;
+        for (int i = 0; i < 3; i++) {
+            if (!std::getline(parts, part, ','))
+                throw std::invalid_argument("expected x,y,z, got '" + value + "'");
+            v[i] = parse<double>(key, part);
+        }
+        return v;
+    }
+
+    // the whole of value as a number for key: std::stoi and std::stod accept a valid prefix and ignore the rest
+    template <typename number>
+    static number parse(const std::string& key, const std::string& value) {
+        size_t used = 0;
+        number result = 0;
+        try {
+            if constexpr (std::is_same_v<number, int>)
+                result = std::stoi(value, &used);
+            else
+                result = std::stod(value, &used);
+        } catch (const std::out_of_range&) {
+            throw std::invalid_argument("value out of range for '" + key + "'");
+        } catch (const std::invalid_argument&) {
+            used = 0;
+        }
+        if (used == 0 || used != value.size())
+            throw std::invalid_argument("expected a number for '" + key + "', got '" + value + "'");
+        return result;
+    }
+
+    static void apply_setting(render_job& job, const std::string& key, const std::string& value) {
+        auto& cam = job.cam;
+        if      (key == "scene")             return;
+        else if (key == "format") {
+            if (value != "ppm" && value != "ppm-binary")
+                throw std::invalid_argument("unknown format '" + value + "'");
+            job.binary = (value == "ppm-binary");
+        }
+        else if (key == "priority")          job.priority = parse<int>(key, value);
+        else if (key == "image_width")       cam.image_width = parse<int>(key, value);
+        else if (key == "aspect_ratio")      cam.aspect_ratio = parse<double>(key, value);
+        else if (key == "samples_per_pixel") cam.samples_per_pixel = parse<int>(key, value);
+        else if (key == "max_depth")         cam.max_depth = parse<int>(key, value);
+        else if (key == "v_fov")             cam.v_fov = parse<double>(key, value);
+        else if (key == "lookfrom")          cam.lookfrom = parse_vec3(key, value);
+        else if (key == "lookat")            cam.lookat = parse_vec3(key, value);
+        else if (key == "vup")               cam.vup = parse_vec3(key, value);
+        else if (key == "defocus_angle")     cam.defocus_angle = parse<double>(key, value);
+        else if (key == "focus_dist")        cam.focus_dist = parse<double>(key, value);
+        else if (key == "tile_size")         cam.tile_size = parse<int>(key, value);
+        else throw std::invalid_argument("unknown key '" + key + "'");
+    }
+
+    void worker_loop() {
+        while (true) {
+            shared_ptr<render_job> job;
+            int tile;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                work_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping)
+                    return;
+
+                // highest priority, then oldest
+                auto next = queue.begin();
+                job = next->second;
+                tile = job->next_tile++;
+                if (job->next_tile == job->tiles_x * job->tiles_y)
+                    queue.erase(next);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(job->progress_mutex);
+                if (!job->started) {
+                    job->started = true;
+                    job->start_time = render_job::clock::now();
+                }
+            }
+
+            if (!job->cancelled)
+                render_tile(*job, tile);
+            tile_done(*job, tile / job->tiles_x);
+        }
+    }
+
+    static void render_tile(render_job& job, int tile) {
+        const auto& cam = job.cam;
+        int col_begin = (tile % job.tiles_x) * cam.tile_size;
+        int row_begin = (tile / job.tiles_x) * cam.tile_size;
+        int col_end = std::min(col_begin + cam.tile_size, cam.image_width);
+        int row_end = std::min(row_begin + cam.tile_size, cam.height());
+
+        for (int row = row_begin; row < row_end; ++row)
+            for (int col = col_begin; col < col_end; ++col)
+                job.pixels[size_t(row) * cam.image_width + col] = cam.sample_pixel(col, row, *job.world);
+    }
+
+    // marks a tile finished, and publishes every leading row of tiles that is now complete
+    static void tile_done(render_job& job, int tile_row) {
+        {
+            std::lock_guard<std::mutex> lock(job.progress_mutex);
+            job.tiles_left[tile_row]--;
+
+            int tile_size = job.cam.tile_size;
+            while (job.rows_ready < job.cam.height() && job.tiles_left[job.rows_ready / tile_size] == 0)
+                job.rows_ready = std::min(job.rows_ready + tile_size, job.cam.height());
+
+            if (job.rows_ready == job.cam.height() && !job.finished) {
+                job.finished = true;
+                job.finish_time = render_job::clock::now();
+            }
+        }
+        job.progress.notify_all();
+    }
+};
+
+#endif //RENDER_SERVICE_H
@@ -3,10 +3,16 @@
 
 // Composite header file to make dependencies more convenient
 
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
 
 
 // C++ Std Usings
@@ -25,8 +31,12 @@ inline double degrees_to_radians(double degrees) {
 }
 
 // Returns a random real in [0,1).
+// each thread owns its generator (rand() serializes render threads on a global lock), seeded in order of first use
 inline double random_double() {
-    return rand() / (RAND_MAX + 1.0);
+    static std::atomic<unsigned> next_seed{5489u};
+    thread_local std::mt19937 generator(next_seed++);
+    thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    return distribution(generator);
 }
 
 // Returns a random real in [min,max).
@@ -34,7 +44,34 @@ inline double random_double(double min, double max) {
     return min + (max-min)*random_double();
 }
 
+// 64-bit FNV-1a hash of the bytes of the values added to it: identifies what a scene renders (see hittable::fingerprint)
+class content_hash {
+  public:
+    template <typename T>
+    content_hash& add(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "add plain values, or strings");
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (unsigned char byte : bytes)
+            hash = (hash ^ byte) * 0x100000001b3ull;
+        return *this;
+    }
+
+    content_hash& add(const std::string& text) {
+        add(text.size());
+        for (unsigned char byte : text)
+            hash = (hash ^ byte) * 0x100000001b3ull;
+        return *this;
+    }
+
+    uint64_t value() const { return hash; }
+
+  private:
+    uint64_t hash = 0xcbf29ce484222325ull;
+};
+
 // Common Headers
+#include "fastmath.h"
 #include "color.h"
 #include "interval.h"
 #include "ray.h"
@@ -0,0 +1,144 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Random numbers for laying out scenes, from a generator of their own with a fixed seed: a scene is then the same in
+// every program and run, whatever random_double() was used for before and however it draws its numbers
+class scene_random {
+  public:
+    explicit scene_random(uint32_t seed) : generator(seed) {}
+
+    // a real in [min,max), from the generator's 32 bits alone so that it doesn't depend on the standard library
+    double operator()(double min = 0, double max = 1) { return min + (max-min) * (generator() / 4294967296.0); }
+
+    color rgb(double min = 0, double max = 1) {
+        auto r = (*this)(min, max);
+        auto g = (*this)(min, max);
+        auto b = (*this)(min, max);
+        return color(r, g, b);
+    }
+
+  private:
+    std::mt19937 generator;
+};
+
+// Final scene of book 1: a field of small random spheres (bouncing, from book 2) around three large ones
+inline void bouncing_spheres(hittable_list& world, camera& cam) {
+    scene_random random(2024);
+
+    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, ground_material));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random();
+            // one draw per statement: the order arguments are evaluated in is up to the compiler
+            auto x = a + 0.9*random();
+            auto z = b + 0.9*random();
+            point3 center(x, 0.2, z);
+
+            // filter for where sphere is on x axis
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<material> sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = random.rgb();
+                    albedo = albedo * random.rgb();
+                    sphere_material = make_shared<lambertian>(albedo);
+                    auto center2 = center + vec3(0, random(0,.5), 0);
+                    world.add(make_shared<sphere>(center, center2, 0.2, sphere_material));
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = random.rgb(0.5, 1);
+                    auto fuzz = random(0, 0.5);
+                    sphere_material = make_shared<metal>(albedo, fuzz);
+                    auto center2 = center + vec3(0, random(0,.5), 0);
+                    world.add(make_shared<sphere>(center, center2, 0.2, sphere_material));
+                } else {
+                    // glass
+                    sphere_material = make_shared<dielectric>(1.5);
+                    auto center2 = center + vec3(0, random(0,.5), 0);
+                    world.add(make_shared<sphere>(center, center2, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    // big glass sphere
+    auto material1 = make_shared<dielectric>(1.5);
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    // big matte sphere
+    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    // big metal sphere
+    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 100;
+    cam.max_depth         = 50;
+
+    cam.v_fov    = 20;
+    cam.lookfrom = point3(13,2,3);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0.6;
+    cam.focus_dist    = 10.0;
+}
+
+// Book 1's material showcase: matte, hollow glass and fuzzy metal spheres on a matte ground, with defocus blur
+inline void three_spheres(hittable_list& world, camera& cam) {
+    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
+    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
+    auto material_left   = make_shared<dielectric>(1.50);
+    auto material_bubble = make_shared<dielectric>(1.00 / 1.50);
+    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
+
+    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
+    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.2),   0.5, material_center));
+    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.5, material_left));
+    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.4, material_bubble));
+    world.add(make_shared<sphere>(point3( 1.0,    0.0, -1.0),   0.5, material_right));
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 100;
+    cam.max_depth         = 50;
+
+    cam.v_fov    = 20;
+    cam.lookfrom = point3(-2,2,1);
+    cam.lookat   = point3(0,0,-1);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 10.0;
+    cam.focus_dist    = 3.4;
+}
+
+using scene_builder = void (*)(hittable_list& world, camera& cam);
+
+// every scene by name, for tools that choose a scene at run time
+inline const std::vector<std::pair<std::string, scene_builder>>& scene_catalog() {
+    static const std::vector<std::pair<std::string, scene_builder>> catalog = {
+        {"bouncing_spheres", bouncing_spheres},
+        {"three_spheres", three_spheres},
+    };
+    return catalog;
+}
+
+#endif //SCENES_H
@@ -44,6 +44,7 @@ public:
         rec.t = root;
         rec.p = r.at(rec.t);
         rec.mat = mat;
+        rec.object = this;
         // set normal at sphere (wherever it is in time of frame), flip if at exit point
         vec3 outward_normal = (rec.p - current_center) / radius;
         rec.set_face_normal(r, outward_normal);
@@ -51,10 +52,49 @@ public:
         return true;
     }
 
+    void surface_coordinates(const ray& r, const hit_record& rec, double& u, double& v, double& uv_width) const override {
+        get_sphere_uv((rec.p - center.at(r.time())) / radius, u, v);
+        // u wraps around the sphere's circumference, so one unit of u is 2*pi*radius of surface
+        uv_width = r.width_at(rec.t) / (2*pi*radius);
+    }
+
+    // Scene edits: moving keeps the sphere's motion (center2 - center1) and changes where it starts
+    void set_center(const point3& new_center) { center = ray(new_center, center.direction()); }
+    void set_material(shared_ptr<material> new_mat) { mat = new_mat; }
+
+    point3 center_at(double time) const { return center.at(time); }
+    double get_radius() const { return radius; }
+    const shared_ptr<material>& get_material() const { return mat; }
+
+    void fingerprint(content_hash& h) const override {
+        h.add(std::string("sphere")).add(center.at(0)).add(center.at(1)).add(radius);
+        mat->fingerprint(h);
+    }
+
+    shared_ptr<hittable> clone() const override {
+        auto copy = make_shared<sphere>(*this);
+        copy->mat = mat->clone();
+        return copy;
+    }
+
 private:
     ray center;             // ray from starting center to ending center (for movement): static spheres move from 0 to 0
     double radius;
     shared_ptr<material> mat;
+
+    // p: a given point on the sphere of radius one, centered at the origin.
+    // u: returned value [0,1] of angle around the Y axis from X=-1.
+    // v: returned value [0,1] of angle from Y=-1 to Y=+1.
+    //     <1 0 0> yields <0.50 0.50>       <-1  0  0> yields <0.00 0.50>
+    //     <0 1 0> yields <0.50 1.00>       < 0 -1  0> yields <0.50 0.00>
+    //     <0 0 1> yields <0.25 0.50>       < 0  0 -1> yields <0.75 0.50>
+    static void get_sphere_uv(const point3& p, double& u, double& v) {
+        auto theta = std::acos(-p.y());
+        auto phi = std::atan2(-p.z(), p.x()) + pi;
+
+        u = phi / (2*pi);
+        v = theta / pi;
+    }
 };
 
 #endif //SPHERE_H
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "rtweekend.h"
+
+#include "texture_cache.h"
+
+#include <filesystem>
+
+// surface color as a function of surface (u,v) coordinates and hit point
+class texture {
+  public:
+    virtual ~texture() = default;
+
+    // uv_width: approximate size of the ray's footprint in uv units, used to pick a filter width
+    virtual color value(double u, double v, const point3& p, double uv_width) const = 0;
+
+    // whether value() ignores u, v and uv_width, so that materials can skip computing them
+    virtual bool uniform() const { return false; }
+
+    // adds the texture's kind and contents to h (see hittable::fingerprint)
+    virtual void fingerprint(content_hash& h) const = 0;
+
+    // copy of this texture, allocated by the calling thread (see hittable::clone)
+    virtual shared_ptr<texture> clone() const = 0;
+};
+
+// the same color everywhere: what materials used before textures
+class solid_color : public texture {
+  public:
+    solid_color(const color& albedo) : albedo(albedo) {}
+
+    solid_color(double red, double green, double blue) : solid_color(color(red,green,blue)) {}
+
+    color value(double u, double v, const point3& p, double uv_width) const override {
+        return albedo;
+    }
+
+    bool uniform() const override { return true; }
+
+    void fingerprint(content_hash& h) const override {
+        h.add(std::string("solid_color")).add(albedo);
+    }
+
+    shared_ptr<texture> clone() const override {
+        return make_shared<solid_color>(*this);
+    }
+
+  private:
+    color albedo;
+};
+
+// image mapped over (u,v), with tiles and mip levels streamed through the global texture_cache
+class image_texture : public texture {
+  public:
+    image_texture(const std::string& filename) : image(texture_cache::global().open(filename)) {}
+
+    color value(double u, double v, const point3& p, double uv_width) const override {
+        // If we have no texture data, then return solid cyan as a debugging aid.
+        if (!image) return color(0,1,1);
+
+        // Clamp input texture coordinates to [0,1] x [1,0]: image rows run top to bottom, v runs bottom to top
+        u = interval(0,1).clamp(u);
+        v = 1.0 - interval(0,1).clamp(v);
+
+        return texture_cache::global().sample(*image, u, v, uv_width);
+    }
+
+    // the image by name, size and modification time, as the cache's mip pyramid tells an image changed
+    void fingerprint(content_hash& h) const override {
+        h.add(std::string("image_texture"));
+        if (!image)
+            return;
+        std::error_code error;
+        auto size = std::filesystem::file_size(image->source_filename(), error);
+        auto time = std::filesystem::last_write_time(image->source_filename(), error).time_since_epoch().count();
+        h.add(image->source_filename()).add(uint64_t(size)).add(int64_t(time));
+    }
+
+    // the texels live in the global texture_cache, so copies share the image rather than reopening it
+    shared_ptr<texture> clone() const override {
+        return make_shared<image_texture>(*this);
+    }
+
+  private:
+    shared_ptr<tiled_image> image;
+};
+
+#endif //TEXTURE_H
@@ -0,0 +1,501 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+// Counters kept by texture_cache, see texture_cache::statistics()
+struct texture_cache_stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t bytes_read = 0;        // tile bytes read from mip pyramid files
+    uint64_t evictions = 0;
+    uint64_t resident_bytes = 0;
+
+    double hit_rate() const {
+        auto lookups = hits + misses;
+        return lookups ? double(hits) / lookups : 0;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const texture_cache_stats& s) {
+    return out << "texture cache: " << s.hits << " hits, " << s.misses << " misses (hit rate " << 100 * s.hit_rate() << "%), "
+               << s.bytes_read << " bytes read from disk, " << s.evictions << " evictions, " << s.resident_bytes << " bytes resident";
+}
+
+// Square block of texels from one mip level, stored as gamma encoded RGB bytes like the PPM it came from
+struct texture_tile {
+    int width = 0, height = 0;          // edge tiles are smaller than tiled_image::tile_size
+    std::vector<unsigned char> rgb;
+
+    // linear color of texel x, y: the inverse of the gamma 2 encoding that write_color applies
+    color texel(int x, int y) const {
+        const unsigned char* t = &rgb[3 * (size_t(y) * width + x)];
+        auto linear = [](unsigned char byte) { double c = byte / 255.0; return c * c; };
+        return color(linear(t[0]), linear(t[1]), linear(t[2]));
+    }
+};
+
+// Binary (P6) PPM image with its mip pyramid on disk. The pyramid is built once, by streaming the image a strip of
+// tile rows at a time, into "<image>.mip" next to it (or the temp directory if that isn't writable), and rebuilt when
+// the image changes. Every level's tiles are stored contiguously, so any tile is read with one seek.
+class tiled_image {
+public:
+    static constexpr int tile_size = 64;
+
+    uint32_t id() const { return image_id; }
+    int width() const { return w; }
+    int height() const { return h; }
+
+    // level 0 is full resolution, each level halves it, down to 1x1
+    int levels() const {
+        int count = 1;
+        for (int size = std::max(w, h); size > 1; size /= 2)
+            count++;
+        return count;
+    }
+    int level_width(int level) const { return std::max(1, w >> level); }
+    int level_height(int level) const { return std::max(1, h >> level); }
+
+    const std::string& source_filename() const { return filename; }
+    const std::string& pyramid_filename() const { return pyramid_name; }
+
+private:
+    friend class texture_cache;
+
+    // mip file layout: header, then every level in turn, each as its rows of tiles top to bottom. The tiles of one row
+    // are stored left to right, each as its own rows of texels, so a tile row of height th takes level_width * th texels.
+    struct pyramid_header {
+        char magic[8] = {'R','T','M','I','P','1','\n','\0'};
+        int32_t width = 0, height = 0;
+        uint64_t source_size = 0;
+        int64_t source_time = 0;
+    };
+
+    uint32_t image_id = 0;
+    std::string filename, pyramid_name;
+    int w = 0, h = 0;
+    std::streamoff data_offset = 0;             // of the image's first texel
+    std::vector<uint64_t> level_offset;
+    mutable std::ifstream pyramid;
+    mutable std::mutex pyramid_mutex;
+
+    // Parses the image header and opens (building it first if needed) the mip pyramid; prints why and returns false
+    // if the file can't be used
+    bool open(const std::string& name) {
+        filename = name;
+        std::ifstream file(name, std::ios::binary);
+        if (!file) {
+            std::cerr << "ERROR: Could not load texture image file '" << name << "'.\n";
+            return false;
+        }
+
+        // header fields are separated by whitespace and may be interleaved with # comments
+        auto next_field = [&file](std::string& field) {
+            field.clear();
+            int c;
+            while ((c = file.get()) != EOF) {
+                if (c == '#') {
+                    while ((c = file.get()) != EOF && c != '\n') {}
+                    continue;
+                }
+                if (std::isspace(c)) {
+                    if (!field.empty()) return true;
+                    continue;
+                }
+                field += char(c);
+            }
+            return !field.empty();
+        };
+
+        std::string magic, width, height, maxval;
+        if (!next_field(magic) || magic != "P6") {
+            std::cerr << "ERROR: Texture image '" << name << "' is not a binary (P6) PPM.\n";
+            return false;
+        }
+        if (!next_field(width) || !next_field(height) || !next_field(maxval) || maxval != "255") {
+            std::cerr << "ERROR: Texture image '" << name << "' has an unsupported PPM header.\n";
+            return false;
+        }
+
+        // the single whitespace character after maxval was consumed by next_field
+        w = std::stoi(width);
+        h = std::stoi(height);
+        data_offset = file.tellg();
+        if (w < 1 || h < 1)
+            return false;
+
+        level_offset.assign(1, sizeof(pyramid_header));
+        for (int level = 0; level < levels(); level++)
+            level_offset.push_back(level_offset.back() + 3 * uint64_t(level_width(level)) * level_height(level));
+
+        std::error_code error;
+        pyramid_header expected;
+        expected.width = w;
+        expected.height = h;
+        expected.source_size = std::filesystem::file_size(name, error);
+        expected.source_time = std::filesystem::last_write_time(name, error).time_since_epoch().count();
+
+        // next to the image, or in the temp directory under a name derived from the image's path
+        std::vector<std::string> candidates = { name + ".mip" };
+        auto absolute = std::filesystem::absolute(name, error).string();
+        candidates.push_back((std::filesystem::temp_directory_path(error)
+                              / ("rt_" + std::to_string(std::hash<std::string>{}(absolute)) + ".mip")).string());
+
+        for (const auto& candidate : candidates)
+            if (open_pyramid(candidate, expected))
+                return true;
+        for (const auto& candidate : candidates)
+            if (build_pyramid(file, candidate, expected) && open_pyramid(candidate, expected))
+                return true;
+
+        std::cerr << "ERROR: Could not write a mip pyramid for texture image '" << name << "'.\n";
+        return false;
+    }
+
+    bool open_pyramid(const std::string& name, const pyramid_header& expected) {
+        pyramid.close();
+        pyramid.clear();
+        pyramid.open(name, std::ios::binary);
+        pyramid_header found;
+        if (!pyramid.read(reinterpret_cast<char*>(&found), sizeof(found)))
+            return false;
+        if (std::string(found.magic, 8) != std::string(expected.magic, 8) || found.width != expected.width
+            || found.height != expected.height || found.source_size != expected.source_size
+            || found.source_time != expected.source_time)
+            return false;
+
+        // a pyramid cut short (e.g. by a full disk) is rebuilt too
+        std::error_code error;
+        if (std::filesystem::file_size(name, error) != level_offset.back())
+            return false;
+        pyramid_name = name;
+        return true;
+    }
+
+    // Streams the image into a new pyramid at name: each level keeps one strip of tile_size rows, which is written out
+    // when full and box filtered into the next level two rows at a time
+    bool build_pyramid(std::ifstream& file, const std::string& name, const pyramid_header& header) {
+        // named for this process and call, so that processes building the same pyramid at once (e.g. the daemon and
+        // a raytrace run) each write their own file, and the last rename wins with a complete one
+        static std::atomic<uint64_t> partial_count{0};
+        std::string partial = name + ".partial." + std::to_string(getpid()) + "." + std::to_string(partial_count++);
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        file.clear();
+        file.seekg(data_offset);
+        std::clog << "building mip pyramid " << name << " for " << filename << "\n";
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        struct level_state {
+            std::vector<unsigned char> strip, pending, tiles;
+            int rows = 0;                   // rows received so far
+        };
+        std::vector<level_state> state(levels());
+        for (int level = 0; level < levels(); level++) {
+            state[level].strip.resize(3 * size_t(level_width(level)) * tile_size);
+            state[level].tiles.resize(state[level].strip.size());
+        }
+
+        std::vector<unsigned char> coarse_row;
+        auto push_row = [&](auto& self, int level, const unsigned char* row) -> void {
+            auto& s = state[level];
+            int lw = level_width(level), lh = level_height(level);
+            size_t row_bytes = 3 * size_t(lw);
+            std::copy(row, row + row_bytes, s.strip.begin() + (s.rows % tile_size) * row_bytes);
+            s.rows++;
+
+            // a full (or the last) strip is one row of tiles: reorder it tile by tile and write it in one go
+            if (s.rows % tile_size == 0 || s.rows == lh) {
+                int th = (s.rows - 1) % tile_size + 1, ty = (s.rows - 1) / tile_size;
+                auto next = s.tiles.begin();
+                for (int x0 = 0; x0 < lw; x0 += tile_size) {
+                    size_t tw_bytes = 3 * size_t(std::min(tile_size, lw - x0));
+                    for (int y = 0; y < th; y++)
+                        next = std::copy_n(s.strip.begin() + y * row_bytes + 3 * size_t(x0), tw_bytes, next);
+                }
+                out.seekp(std::streamoff(level_offset[level] + uint64_t(ty) * tile_size * row_bytes));
+                out.write(reinterpret_cast<const char*>(s.tiles.data()), std::streamsize(th * row_bytes));
+            }
+
+            if (level + 1 == levels())
+                return;
+
+            // 2x2 box filter, averaged in linear space (texel()) and re-encoded with gamma 2. Coarser sizes are rounded
+            // down, so an odd last row or column is dropped, except that a level of width or height 1 is reused.
+            int r = s.rows - 1;
+            if (r % 2 == 0 && lh > 1) {
+                s.pending.assign(row, row + row_bytes);
+                return;
+            }
+            const unsigned char* upper = (r % 2 == 0) ? row : s.pending.data();
+            int cw = level_width(level + 1);
+            coarse_row.resize(3 * size_t(cw));
+            for (int x = 0; x < cw; x++) {
+                int x1 = std::min(2*x + 1, lw - 1);
+                for (int c = 0; c < 3; c++) {
+                    double sum = 0;
+                    for (const unsigned char* line : { upper, row })
+                        for (int fx : { 2*x, x1 }) {
+                            double value = line[3*fx + c] / 255.0;
+                            sum += value * value;
+                        }
+                    coarse_row[3*x + c] = (unsigned char)(255.0 * std::sqrt(0.25 * sum) + 0.5);
+                }
+            }
+            auto filtered = coarse_row;     // coarse_row is reused by the recursion
+            self(self, level + 1, filtered.data());
+        };
+
+        std::vector<unsigned char> row(3 * size_t(w));
+        for (int y = 0; y < h; y++) {
+            if (!file.read(reinterpret_cast<char*>(row.data()), std::streamsize(row.size()))) {
+                std::cerr << "ERROR: Texture image '" << filename << "' is shorter than its header says.\n";
+                break;
+            }
+            push_row(push_row, 0, row.data());
+        }
+
+        out.close();
+        std::error_code error;
+        if (file && out)
+            std::filesystem::rename(partial, name, error);
+        else
+            std::filesystem::remove(partial, error);
+        return file && out && !error;
+    }
+
+    // reads tile tx, ty of the given level into t, which already has its size
+    bool read_tile(int level, int tx, int ty, texture_tile& t) const {
+        size_t row_bytes = 3 * size_t(level_width(level));
+        uint64_t offset = level_offset[level] + uint64_t(ty) * tile_size * row_bytes + uint64_t(tx) * tile_size * 3 * t.height;
+
+        std::lock_guard<std::mutex> lock(pyramid_mutex);
+        pyramid.seekg(std::streamoff(offset));
+        if (!pyramid.read(reinterpret_cast<char*>(t.rgb.data()), std::streamsize(t.rgb.size()))) {
+            pyramid.clear();
+            return false;
+        }
+        return true;
+    }
+};
+
+// Process-wide cache of texture tiles under one memory budget, shared by all images. Tiles of every mip level are read
+// straight from the images' pyramid files. The index is split into independently locked shards so that render
+// threads rarely wait on each other, but the budget is global: eviction takes the least recently used tile of all
+// shards. All members are safe to call from any number of render threads.
+class texture_cache {
+public:
+    explicit texture_cache(size_t budget_bytes) : budget(budget_bytes) {}
+
+    // the cache used by image_texture
+    static texture_cache& global() {
+        static texture_cache cache(size_t(256) << 20);
+        return cache;
+    }
+
+    // Budget for the tile data of all images together. Lowering it takes effect as tiles are next inserted.
+    void set_budget(size_t bytes) { budget = bytes; }
+
+    // null (after printing why) if the image can't be used
+    shared_ptr<tiled_image> open(const std::string& filename) {
+        auto image = make_shared<tiled_image>();
+        if (!image->open(filename))
+            return nullptr;
+        image->image_id = next_image_id++;
+        return image;
+    }
+
+    // Bilinearly filtered linear color at u, v (both in [0,1], v pointing down the image), from the mip level where one
+    // texel is about uv_width across. uv_width 0 samples full resolution.
+    color sample(const tiled_image& image, double u, double v, double uv_width) {
+        int level = 0;
+        if (uv_width > 0) {
+            double lod = std::log2(uv_width * std::max(image.width(), image.height()));
+            level = std::clamp(int(std::floor(lod)), 0, image.levels() - 1);
+        }
+
+        int w = image.level_width(level), h = image.level_height(level);
+        double x = u * w - 0.5, y = v * h - 0.5;
+        int x0 = int(std::floor(x)), y0 = int(std::floor(y));
+        double fx = x - x0, fy = y - y0;
+
+        // the four texels usually share a tile: only refetch when crossing into another
+        shared_ptr<const texture_tile> current;
+        int current_tx = -1, current_ty = -1;
+        auto texel = [&](int tx, int ty) {
+            tx = std::clamp(tx, 0, w - 1);
+            ty = std::clamp(ty, 0, h - 1);
+            int tile_x = tx / tiled_image::tile_size, tile_y = ty / tiled_image::tile_size;
+            if (!current || tile_x != current_tx || tile_y != current_ty) {
+                current = tile(image, level, tile_x, tile_y);
+                current_tx = tile_x;
+                current_ty = tile_y;
+            }
+            return current->texel(tx % tiled_image::tile_size, ty % tiled_image::tile_size);
+        };
+
+        return (1-fy) * ((1-fx) * texel(x0, y0)   + fx * texel(x0+1, y0))
+             +    fy  * ((1-fx) * texel(x0, y0+1) + fx * texel(x0+1, y0+1));
+    }
+
+    // tile tx, ty of the given mip level, loading it on a miss
+    shared_ptr<const texture_tile> tile(const tiled_image& image, int level, int tx, int ty) {
+        tile_key key{image.id(), level, tx, ty};
+        auto& s = shards[tile_key_hash{}(key) % shard_count];
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto found = s.index.find(key);
+            if (found != s.index.end()) {
+                found->second->last_use = ++use_clock;
+                s.lru.splice(s.lru.begin(), s.lru, found->second);
+                hits++;
+                return found->second->data;
+            }
+        }
+
+        // load without holding the shard lock, as disk reads are slow. Two threads missing on the same tile both
+        // load it, and the second insert just reuses the first.
+        misses++;
+        auto loaded = load(image, level, tx, ty);
+        size_t size = tile_bytes(*loaded);
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto found = s.index.find(key);
+            if (found != s.index.end())
+                return found->second->data;
+
+            s.lru.push_front({key, ++use_clock, loaded});
+            s.index[key] = s.lru.begin();
+            resident_bytes += size;
+        }
+
+        evict_until_within_budget(key);
+        return loaded;
+    }
+
+    texture_cache_stats statistics() const {
+        texture_cache_stats stats;
+        stats.hits = hits;
+        stats.misses = misses;
+        stats.bytes_read = bytes_read;
+        stats.evictions = evictions;
+        stats.resident_bytes = resident_bytes;
+        return stats;
+    }
+
+private:
+    static constexpr int shard_count = 16;
+
+    // every field in full: image ids count all open() calls, and a long running process can make more than would
+    // fit beside the tile coordinates in one 64 bit word
+    struct tile_key {
+        uint32_t image;
+        int level, tx, ty;
+
+        bool operator==(const tile_key&) const = default;
+    };
+
+    // splitmix64 finalizer over the packed coordinates, folded with the image id: keys differ mostly in their low
+    // (tile row) bits, which would otherwise pick the shard alone
+    struct tile_key_hash {
+        size_t operator()(const tile_key& k) const {
+            uint64_t coordinates = (uint64_t(k.level) << 58) ^ (uint64_t(uint32_t(k.tx)) << 29) ^ uint64_t(uint32_t(k.ty));
+            return size_t(mix(mix(coordinates) ^ k.image));
+        }
+    };
+
+    struct entry {
+        tile_key key;
+        uint64_t last_use;          // use_clock at the last lookup: orders entries across shards
+        shared_ptr<const texture_tile> data;
+    };
+
+    // one independently locked slice of the index; its list is in use order, so its back is its oldest entry
+    struct shard {
+        std::mutex mutex;
+        std::list<entry> lru;       // most recently used first
+        std::unordered_map<tile_key, std::list<entry>::iterator, tile_key_hash> index;
+    };
+
+    shard shards[shard_count];
+    std::mutex eviction_mutex;
+    std::atomic<size_t> budget;
+    std::atomic<uint32_t> next_image_id{0};
+    std::atomic<uint64_t> use_clock{0};
+    std::atomic<uint64_t> hits{0}, misses{0}, bytes_read{0}, evictions{0}, resident_bytes{0};
+
+    // splitmix64 finalizer
+    static uint64_t mix(uint64_t key) {
+        key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+        key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+        return key ^ (key >> 31);
+    }
+
+    static size_t tile_bytes(const texture_tile& t) {
+        return sizeof(entry) + sizeof(texture_tile) + t.rgb.size();
+    }
+
+    // Evicts the least recently used tile of the whole cache, by comparing the shards' oldest entries, until the
+    // resident bytes are within budget. The tile just inserted (keep) stays even if it alone exceeds the budget.
+    void evict_until_within_budget(const tile_key& keep) {
+        std::lock_guard<std::mutex> eviction(eviction_mutex);
+        while (resident_bytes > budget) {
+            int oldest = -1;
+            uint64_t oldest_use = 0;
+            for (int i = 0; i < shard_count; i++) {
+                std::lock_guard<std::mutex> lock(shards[i].mutex);
+                if (shards[i].lru.empty() || shards[i].lru.back().key == keep)
+                    continue;
+                if (oldest < 0 || shards[i].lru.back().last_use < oldest_use) {
+                    oldest = i;
+                    oldest_use = shards[i].lru.back().last_use;
+                }
+            }
+            if (oldest < 0)
+                return;
+
+            // the entry may have been used (and so moved up) since it was compared: then the next pass picks again
+            auto& s = shards[oldest];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (s.lru.empty() || s.lru.back().last_use != oldest_use)
+                continue;
+            resident_bytes -= tile_bytes(*s.lru.back().data);
+            evictions++;
+            s.index.erase(s.lru.back().key);
+            s.lru.pop_back();
+        }
+    }
+
+    shared_ptr<const texture_tile> load(const tiled_image& image, int level, int tx, int ty) {
+        auto t = make_shared<texture_tile>();
+        t->width = std::min(tiled_image::tile_size, image.level_width(level) - tx * tiled_image::tile_size);
+        t->height = std::min(tiled_image::tile_size, image.level_height(level) - ty * tiled_image::tile_size);
+        t->rgb.resize(3 * size_t(t->width) * t->height);
+
+        if (image.read_tile(level, tx, ty, *t))
+            bytes_read += t->rgb.size();
+        else
+            std::cerr << "ERROR: Could not read texels from '" << image.pyramid_filename() << "'.\n";
+        return t;
+    }
+};
+
+#endif //TEXTURE_CACHE_H
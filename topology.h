@@ -0,0 +1,108 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// parses a sysfs cpu list such as "0-3,8-11" into individual cpu ids
+inline std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        } catch (const std::exception&) {
+            // blank or trailing entries (e.g. the newline at the end of the file)
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+// Logical CPUs grouped by the NUMA node (socket / memory controller) they are attached to
+class cpu_topology {
+public:
+    std::vector<std::vector<int>> nodes;    // nodes[n] lists the cpu ids local to node n
+
+    // Reads the node layout from /sys/devices/system/node, keeping only cpus this process may run on.
+    // Machines without NUMA information become one node holding the cpus of the affinity mask, or, where there is no
+    // mask either, one node with an empty list, whose workers stay unpinned.
+    static cpu_topology detect() {
+        cpu_topology topo;
+
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool have_mask = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string node_list;
+        if (online && std::getline(online, node_list)) {
+            for (int node : parse_cpu_list(node_list)) {
+                std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string cpu_list;
+                if (!cpulist || !std::getline(cpulist, cpu_list))
+                    continue;
+
+                std::vector<int> cpus;
+                for (int cpu : parse_cpu_list(cpu_list))
+                    if (!have_mask || CPU_ISSET(cpu, &allowed))
+                        cpus.push_back(cpu);
+
+                // memory-only nodes have no cores to run workers on
+                if (!cpus.empty())
+                    topo.nodes.push_back(cpus);
+            }
+        }
+#endif
+
+        if (topo.nodes.empty()) {
+            topo.nodes.emplace_back();
+#ifdef __linux__
+            if (have_mask)
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                    if (CPU_ISSET(cpu, &allowed))
+                        topo.nodes[0].push_back(cpu);
+#endif
+        }
+
+        return topo;
+    }
+
+    // cpus across all nodes; without any known cpu ids, every core the hardware reports
+    int core_count() const {
+        int count = 0;
+        for (const auto& node : nodes)
+            count += int(node.size());
+        return count > 0 ? count : int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+};
+
+// restricts the calling thread to a single logical cpu: returns false where affinity isn't supported
+inline bool pin_thread_to_cpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+#endif //TOPOLOGY_H
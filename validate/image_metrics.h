@@ -0,0 +1,283 @@
+#ifndef IMAGE_METRICS_H
+#define IMAGE_METRICS_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <vector>
+
+// Display-space image: gamma encoded like write_color's output, but kept as doubles in [0,1]
+struct display_image {
+    int width = 0, height = 0;
+    std::vector<color> pixels;
+
+    color& at(int x, int y) { return pixels[size_t(y) * width + x]; }
+    const color& at(int x, int y) const { return pixels[size_t(y) * width + x]; }
+};
+
+// single channel image, used for the intermediate results of the metrics below
+struct channel_image {
+    int width = 0, height = 0;
+    std::vector<double> values;
+
+    channel_image(int width, int height) : width(width), height(height), values(size_t(width) * height, 0.0) {}
+
+    double& at(int x, int y) { return values[size_t(y) * width + x]; }
+    double at(int x, int y) const { return values[size_t(y) * width + x]; }
+
+    // clamped to the nearest edge pixel, so filters don't darken borders
+    double at_clamped(int x, int y) const {
+        return at(std::clamp(x, 0, width - 1), std::clamp(y, 0, height - 1));
+    }
+};
+
+// same mapping as write_color, without the quantization to bytes
+inline color to_display(const color& linear) {
+    interval intensity(0.0, 1.0);
+    return color(intensity.clamp(linear_to_gamma(linear.x())),
+                 intensity.clamp(linear_to_gamma(linear.y())),
+                 intensity.clamp(linear_to_gamma(linear.z())));
+}
+
+// root mean square difference over all channels of all pixels
+inline double rmse(const display_image& a, const display_image& b) {
+    double sum = 0;
+    for (size_t i = 0; i < a.pixels.size(); i++) {
+        vec3 d = a.pixels[i] - b.pixels[i];
+        sum += d.length_squared();
+    }
+    return std::sqrt(sum / (3.0 * a.pixels.size()));
+}
+
+inline double psnr(double rmse) {
+    return rmse > 0 ? 20 * std::log10(1.0 / rmse) : infinity;
+}
+
+// 2D convolution with a square, odd sized kernel of the given radius
+inline channel_image convolve(const channel_image& image, const std::vector<double>& kernel, int radius) {
+    channel_image out(image.width, image.height);
+    int size = 2 * radius + 1;
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            double sum = 0;
+            for (int ky = -radius; ky <= radius; ky++)
+                for (int kx = -radius; kx <= radius; kx++)
+                    sum += kernel[(ky + radius) * size + (kx + radius)] * image.at_clamped(x + kx, y + ky);
+            out.at(x, y) = sum;
+        }
+    }
+    return out;
+}
+
+// Mean structural similarity of luma (Wang et al. 2004): 11x11 Gaussian window with sigma 1.5, K1 = 0.01, K2 = 0.03
+inline double ssim(const display_image& a, const display_image& b) {
+    const int radius = 5;
+    const double sigma = 1.5, c1 = 0.01 * 0.01, c2 = 0.03 * 0.03;
+
+    std::vector<double> window;
+    double total = 0;
+    for (int y = -radius; y <= radius; y++)
+        for (int x = -radius; x <= radius; x++) {
+            window.push_back(std::exp(-(x*x + y*y) / (2 * sigma * sigma)));
+            total += window.back();
+        }
+    for (auto& w : window) w /= total;
+
+    channel_image la(a.width, a.height), lb(a.width, a.height), aa(a.width, a.height), bb(a.width, a.height), ab(a.width, a.height);
+    for (size_t i = 0; i < a.pixels.size(); i++) {
+        const auto& p = a.pixels[i];
+        const auto& q = b.pixels[i];
+        la.values[i] = 0.299 * p.x() + 0.587 * p.y() + 0.114 * p.z();
+        lb.values[i] = 0.299 * q.x() + 0.587 * q.y() + 0.114 * q.z();
+        aa.values[i] = la.values[i] * la.values[i];
+        bb.values[i] = lb.values[i] * lb.values[i];
+        ab.values[i] = la.values[i] * lb.values[i];
+    }
+
+    auto mu_a = convolve(la, window, radius), mu_b = convolve(lb, window, radius);
+    auto e_aa = convolve(aa, window, radius), e_bb = convolve(bb, window, radius), e_ab = convolve(ab, window, radius);
+
+    double sum = 0;
+    for (size_t i = 0; i < a.pixels.size(); i++) {
+        double ma = mu_a.values[i], mb = mu_b.values[i];
+        double var_a = e_aa.values[i] - ma*ma, var_b = e_bb.values[i] - mb*mb, cov = e_ab.values[i] - ma*mb;
+        sum += ((2*ma*mb + c1) * (2*cov + c2)) / ((ma*ma + mb*mb + c1) * (var_a + var_b + c2));
+    }
+    return sum / a.pixels.size();
+}
+
+// LDR-FLIP (Andersson et al. 2020), mean over the image: 0 is identical, 1 is maximally different.
+// Follows the reference implementation's color and feature pipelines, viewed at 67 pixels per degree.
+class flip_metric {
+public:
+    static double mean(const display_image& reference, const display_image& test) {
+        int w = reference.width, h = reference.height;
+
+        // color pipeline: CSF filter in YCxCz, then Hunt adjusted HyAB distance in L*a*b*
+        auto ref_lab = filtered_lab(reference), test_lab = filtered_lab(test);
+        double cmax = std::pow(hyab(hunt(linrgb_to_lab(vec3(0,1,0))), hunt(linrgb_to_lab(vec3(0,0,1)))), qc);
+
+        // feature pipeline: edge and point detectors on normalized luminance
+        auto ref_y = luminance(reference), test_y = luminance(test);
+        auto ref_edges = features(ref_y, false), test_edges = features(test_y, false);
+        auto ref_points = features(ref_y, true), test_points = features(test_y, true);
+
+        double sum = 0;
+        for (size_t i = 0; i < size_t(w) * h; i++) {
+            double color_error = redistribute(std::pow(hyab(ref_lab[i], test_lab[i]), qc), cmax);
+            double feature_error = std::max(std::fabs(ref_edges.values[i] - test_edges.values[i]),
+                                            std::fabs(ref_points.values[i] - test_points.values[i]));
+            feature_error = std::pow(feature_error / std::sqrt(2.0), qf);
+            sum += std::pow(color_error, 1 - feature_error);
+        }
+        return sum / (double(w) * h);
+    }
+
+private:
+    static constexpr double pixels_per_degree = 67.0;
+    static constexpr double qc = 0.7, qf = 0.5, pc = 0.4, pt = 0.95;
+
+    static double srgb_to_linear(double c) {
+        return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+    }
+
+    static vec3 linrgb_to_xyz(const vec3& c) {
+        return vec3(0.4124564 * c.x() + 0.3575761 * c.y() + 0.1804375 * c.z(),
+                    0.2126729 * c.x() + 0.7151522 * c.y() + 0.0721750 * c.z(),
+                    0.0193339 * c.x() + 0.1191920 * c.y() + 0.9503041 * c.z());
+    }
+
+    static vec3 xyz_to_linrgb(const vec3& c) {
+        return vec3( 3.2404542 * c.x() - 1.5371385 * c.y() - 0.4985314 * c.z(),
+                    -0.9692660 * c.x() + 1.8760108 * c.y() + 0.0415560 * c.z(),
+                     0.0556434 * c.x() - 0.2040259 * c.y() + 1.0572252 * c.z());
+    }
+
+    // D65 white point: xyz of linear rgb (1,1,1)
+    static vec3 white() {
+        return linrgb_to_xyz(vec3(1,1,1));
+    }
+
+    static vec3 xyz_to_ycxcz(const vec3& xyz) {
+        vec3 n(xyz.x() / white().x(), xyz.y() / white().y(), xyz.z() / white().z());
+        return vec3(116 * n.y() - 16, 500 * (n.x() - n.y()), 200 * (n.y() - n.z()));
+    }
+
+    static vec3 ycxcz_to_xyz(const vec3& ycxcz) {
+        double y = (ycxcz.x() + 16) / 116;
+        return vec3((y + ycxcz.y() / 500) * white().x(), y * white().y(), (y - ycxcz.z() / 200) * white().z());
+    }
+
+    static vec3 linrgb_to_lab(const vec3& c) {
+        vec3 xyz = linrgb_to_xyz(c);
+        vec3 n(xyz.x() / white().x(), xyz.y() / white().y(), xyz.z() / white().z());
+        const double delta = 6.0 / 29.0;
+        auto f = [&](double t) { return t > delta*delta*delta ? std::cbrt(t) : t / (3*delta*delta) + 4.0 / 29.0; };
+        return vec3(116 * f(n.y()) - 16, 500 * (f(n.x()) - f(n.y())), 200 * (f(n.y()) - f(n.z())));
+    }
+
+    static vec3 hunt(const vec3& lab) {
+        return vec3(lab.x(), 0.01 * lab.x() * lab.y(), 0.01 * lab.x() * lab.z());
+    }
+
+    static double hyab(const vec3& a, const vec3& b) {
+        double da = a.y() - b.y(), db = a.z() - b.z();
+        return std::fabs(a.x() - b.x()) + std::sqrt(da*da + db*db);
+    }
+
+    static double redistribute(double error, double cmax) {
+        if (error < pc * cmax)
+            return pt / (pc * cmax) * error;
+        return pt + ((error - pc * cmax) / (cmax - pc * cmax)) * (1 - pt);
+    }
+
+    // contrast sensitivity filter per opponent channel, as a normalized kernel
+    static std::vector<double> csf_kernel(int channel, int& radius) {
+        const double a1[3] = {1, 1, 34.1}, b1[3] = {0.0047, 0.0053, 0.04};
+        const double a2[3] = {0, 0, 13.5}, b2[3] = {1e-5, 1e-5, 0.025};
+        radius = int(std::ceil(3 * std::sqrt(0.04 / (2 * pi * pi)) * pixels_per_degree));
+
+        std::vector<double> kernel;
+        double total = 0;
+        double dx = 1.0 / pixels_per_degree;
+        for (int y = -radius; y <= radius; y++)
+            for (int x = -radius; x <= radius; x++) {
+                double z = (x*dx)*(x*dx) + (y*dx)*(y*dx);
+                double g = a1[channel] * std::sqrt(pi / b1[channel]) * std::exp(-pi*pi * z / b1[channel])
+                         + a2[channel] * std::sqrt(pi / b2[channel]) * std::exp(-pi*pi * z / b2[channel]);
+                kernel.push_back(g);
+                total += g;
+            }
+        for (auto& k : kernel) k /= total;
+        return kernel;
+    }
+
+    static std::vector<vec3> filtered_lab(const display_image& image) {
+        int w = image.width, h = image.height;
+        std::vector<channel_image> channels(3, channel_image(w, h));
+        for (size_t i = 0; i < image.pixels.size(); i++) {
+            const auto& p = image.pixels[i];
+            vec3 ycxcz = xyz_to_ycxcz(linrgb_to_xyz(vec3(srgb_to_linear(p.x()), srgb_to_linear(p.y()), srgb_to_linear(p.z()))));
+            for (int c = 0; c < 3; c++)
+                channels[c].values[i] = ycxcz[c];
+        }
+
+        for (int c = 0; c < 3; c++) {
+            int radius;
+            auto kernel = csf_kernel(c, radius);
+            channels[c] = convolve(channels[c], kernel, radius);
+        }
+
+        std::vector<vec3> lab(image.pixels.size());
+        for (size_t i = 0; i < lab.size(); i++) {
+            vec3 rgb = xyz_to_linrgb(ycxcz_to_xyz(vec3(channels[0].values[i], channels[1].values[i], channels[2].values[i])));
+            for (int c = 0; c < 3; c++)
+                rgb[c] = std::clamp(rgb[c], 0.0, 1.0);
+            lab[i] = hunt(linrgb_to_lab(rgb));
+        }
+        return lab;
+    }
+
+    // achromatic channel normalized to [0,1]
+    static channel_image luminance(const display_image& image) {
+        channel_image y(image.width, image.height);
+        for (size_t i = 0; i < image.pixels.size(); i++) {
+            const auto& p = image.pixels[i];
+            vec3 ycxcz = xyz_to_ycxcz(linrgb_to_xyz(vec3(srgb_to_linear(p.x()), srgb_to_linear(p.y()), srgb_to_linear(p.z()))));
+            y.values[i] = (ycxcz.x() + 16) / 116;
+        }
+        return y;
+    }
+
+    // magnitude of the edge (first derivative of Gaussian) or point (second derivative) response
+    static channel_image features(const channel_image& y, bool points) {
+        double sd = 0.5 * 0.082 * pixels_per_degree;
+        int radius = int(std::ceil(3 * sd));
+        int size = 2 * radius + 1;
+
+        std::vector<double> gx(size * size);
+        double negative = 0, positive = 0;
+        for (int j = -radius; j <= radius; j++)
+            for (int i = -radius; i <= radius; i++) {
+                double g = std::exp(-(i*i + j*j) / (2 * sd * sd));
+                double k = points ? (i*i / (sd*sd) - 1) * g : -i * g;
+                gx[(j + radius) * size + (i + radius)] = k;
+                (k < 0 ? negative : positive) += std::fabs(k);
+            }
+        for (auto& k : gx)
+            k = k < 0 ? k / negative : k / positive;
+
+        std::vector<double> gy(size * size);
+        for (int j = 0; j < size; j++)
+            for (int i = 0; i < size; i++)
+                gy[j * size + i] = gx[i * size + j];
+
+        auto fx = convolve(y, gx, radius), fy = convolve(y, gy, radius);
+        channel_image magnitude(y.width, y.height);
+        for (size_t i = 0; i < magnitude.values.size(); i++)
+            magnitude.values[i] = std::sqrt(fx.values[i] * fx.values[i] + fy.values[i] * fy.values[i]);
+        return magnitude;
+    }
+};
+
+#endif //IMAGE_METRICS_H
@@ -0,0 +1,343 @@
+// Statistical image-equivalence harness: renders each scene at a lower sample count with this build and checks that
+// it agrees up to noise with a reference rendered at a high sample count. References are never rendered by the build
+// under test, which would only compare it with itself: --make-reference, run from a known-good exact build, renders
+// them into the cache, and a plain run fails when its reference is missing. References are keyed by a fingerprint of
+// the scene and camera, so a changed scene is never compared against a stale one. Reports throughput next to the
+// accuracy numbers, and exits non-zero when any gate fails, for regression runs.
+//
+// usage: validate [--make-reference] [--scene name] [--width n] [--reference-spp n] [--spp n] [--threads n]
+//                 [--cache dir] [--max-fail-fraction x] [--max-rmse x] [--min-ssim x] [--max-flip x]
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "scenes.h"
+#include "validate/image_metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// which kernels this binary renders with: --make-reference only runs in an exact build
+#ifdef RT_FAST_MATH
+const char* build_kind = "fast-math";
+#else
+const char* build_kind = "exact";
+#endif
+
+// Per-pixel sums of sample values and squared sample values: enough for the mean and variance of every pixel. The
+// channels of a sample are correlated (a path brings light in all three), so the squares of their total are kept too.
+struct sample_stats {
+    int width = 0, height = 0, samples = 0;
+    std::vector<color> sum, sum_sq;
+    std::vector<double> total_sq;       // sum of (r + g + b)^2
+
+    color mean(size_t i) const { return sum[i] / samples; }
+
+    // unbiased sample variance of one sample, per channel
+    color variance(size_t i) const {
+        color m = mean(i);
+        color v = (sum_sq[i] - samples * (m * m)) / (samples - 1);
+        return color(std::fmax(0, v.x()), std::fmax(0, v.y()), std::fmax(0, v.z()));
+    }
+
+    // unbiased sample variance of one sample's channel total
+    double total_variance(size_t i) const {
+        double m = (sum[i].x() + sum[i].y() + sum[i].z()) / samples;
+        return std::fmax(0, (total_sq[i] - samples * m * m) / (samples - 1));
+    }
+
+    display_image display() const {
+        display_image image;
+        image.width = width;
+        image.height = height;
+        for (size_t i = 0; i < sum.size(); i++)
+            image.pixels.push_back(to_display(mean(i)));
+        return image;
+    }
+
+    bool save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        out.write("RTREF2", 6);
+        out.write(reinterpret_cast<const char*>(&width), sizeof(width));
+        out.write(reinterpret_cast<const char*>(&height), sizeof(height));
+        out.write(reinterpret_cast<const char*>(&samples), sizeof(samples));
+        out.write(reinterpret_cast<const char*>(sum.data()), sum.size() * sizeof(color));
+        out.write(reinterpret_cast<const char*>(sum_sq.data()), sum_sq.size() * sizeof(color));
+        out.write(reinterpret_cast<const char*>(total_sq.data()), total_sq.size() * sizeof(double));
+        return bool(out);
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        char magic[6];
+        if (!in.read(magic, 6) || std::string(magic, 6) != "RTREF2")
+            return false;
+        in.read(reinterpret_cast<char*>(&width), sizeof(width));
+        in.read(reinterpret_cast<char*>(&height), sizeof(height));
+        in.read(reinterpret_cast<char*>(&samples), sizeof(samples));
+        if (!in || width < 1 || height < 1 || samples < 2)
+            return false;
+        sum.resize(size_t(width) * height);
+        sum_sq.resize(sum.size());
+        total_sq.resize(sum.size());
+        in.read(reinterpret_cast<char*>(sum.data()), sum.size() * sizeof(color));
+        in.read(reinterpret_cast<char*>(sum_sq.data()), sum_sq.size() * sizeof(color));
+        in.read(reinterpret_cast<char*>(total_sq.data()), total_sq.size() * sizeof(double));
+        return bool(in);
+    }
+};
+
+// renders with per-sample statistics on every core, returning wall time in seconds
+double render_stats(const camera& cam, const hittable& world, int threads, sample_stats& stats) {
+    stats.width = cam.image_width;
+    stats.height = cam.height();
+    stats.samples = cam.samples_per_pixel;
+    stats.sum.assign(size_t(stats.width) * stats.height, color(0,0,0));
+    stats.sum_sq.assign(stats.sum.size(), color(0,0,0));
+    stats.total_sq.assign(stats.sum.size(), 0);
+
+    std::atomic<int> next_row{0};
+    auto worker = [&] {
+        for (int row = next_row++; row < stats.height; row = next_row++) {
+            for (int col = 0; col < stats.width; col++) {
+                size_t i = size_t(row) * stats.width + col;
+                for (int s = 0; s < stats.samples; s++) {
+                    color c = cam.sample_pixel(col, row, world, 1, nullptr);
+                    stats.sum[i] += c;
+                    stats.sum_sq[i] += c * c;
+                    stats.total_sq[i] += (c.x() + c.y() + c.z()) * (c.x() + c.y() + c.z());
+                }
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; i++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& thread : pool)
+        thread.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct gates {
+    double z = 3.29;                    // two sided per-channel critical value, alpha = 0.001
+    double max_fail_fraction = -1;      // pixels allowed to fail the per-pixel test; negative: calibrated (see below)
+    double calibration_z = 3.29;        // one sided critical value for failures above the calibrated chance rate
+    double bias_z = 3.29;               // critical value for the whole-image mean difference
+    double max_rmse = 0.1;
+    double min_ssim = 0.5;
+    double max_flip = 0.25;
+};
+
+// Pixels where some channel of candidate differs from reference at |z| > z, in a two sample test on linear radiance.
+// Under the null hypothesis both renders sample the same distribution, so its variance comes from the reference:
+// a low sample candidate often misses rare bright paths entirely, and would underestimate its own variance.
+size_t failing_pixels(const sample_stats& candidate, const sample_stats& reference, double z) {
+    size_t failed = 0;
+    for (size_t i = 0; i < candidate.sum.size(); i++) {
+        color diff = candidate.mean(i) - reference.mean(i);
+        color var = reference.variance(i) * (1.0 / candidate.samples + 1.0 / reference.samples);
+        bool fail = false;
+        for (int c = 0; c < 3; c++) {
+            double se = std::sqrt(var[c]);
+            fail |= (se > 1e-12) ? std::fabs(diff[c]) > z * se : std::fabs(diff[c]) > 1e-9;
+        }
+        failed += fail;
+    }
+    return failed;
+}
+
+// Compares one scene and prints the speed/accuracy report; returns whether every gate passed. With --make-reference,
+// renders the missing reference and chance failure rate into the cache instead. Throws runtime_error when the cache
+// lacks either in a normal run, or can't be written.
+bool validate_scene(const std::string& name, scene_builder build, const std::map<std::string, std::string>& options, const gates& g) {
+    auto option = [&](const std::string& key, const std::string& fallback) {
+        auto found = options.find(key);
+        return found == options.end() ? fallback : found->second;
+    };
+
+    hittable_list world;
+    camera cam;
+    build(world, cam);
+    cam.image_width = std::stoi(option("width", "160"));
+    int threads = std::stoi(option("threads", "0"));
+    if (threads < 1) threads = int(std::max(1u, std::thread::hardware_concurrency()));
+
+    // reference, from the cache, for this exact scene and camera at this sample count
+    bool make_reference = options.count("make-reference");
+    sample_stats reference;
+    cam.samples_per_pixel = std::stoi(option("reference-spp", "512"));
+    cam.initialize();
+    content_hash fingerprint;
+    world.fingerprint(fingerprint);
+    cam.fingerprint(fingerprint);
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)fingerprint.value());
+
+    std::filesystem::path cache = option("cache", "validate/references");
+    std::string stem = name + "_" + std::to_string(cam.image_width) + "x" + std::to_string(cam.height())
+                     + "_" + std::to_string(cam.samples_per_pixel) + "spp_" + hex;
+    auto cache_file = cache / (stem + ".ref");
+
+    bool cached = reference.load(cache_file.string()) && reference.samples == cam.samples_per_pixel
+                  && reference.width == cam.image_width && reference.height == cam.height();
+    if (!cached) {
+        if (!make_reference)
+            throw std::runtime_error("no reference for scene " + name + " in " + cache_file.string()
+                                     + ": run validate --make-reference with the same options from a known-good build first");
+        std::clog << "rendering reference for " << name << " at " << cam.samples_per_pixel << " spp...\n";
+        double seconds = render_stats(cam, world, threads, reference);
+        std::clog << "reference took " << seconds << " s\n";
+        std::filesystem::create_directories(cache);
+        if (!reference.save(cache_file.string()))
+            throw std::runtime_error("could not write the reference " + cache_file.string());
+    }
+
+    cam.samples_per_pixel = std::stoi(option("spp", "32"));
+    cam.initialize();
+    double pixels = double(reference.sum.size());
+
+    // The per-pixel z test assumes normal pixel means, which a few samples of heavy tailed radiance are not: more
+    // pixels fail by chance than alpha says (near 1% at 16 spp). So the chance rate is measured instead, once per
+    // reference and candidate sample count: an independent render at the candidate's count, cached next to the
+    // reference and, like it, only made by --make-reference. The candidate may fail more pixels by calibration_z
+    // binomial standard deviations of the difference between two such rates.
+    double null_rate = -1;
+    auto null_file = cache / (stem + "_null" + std::to_string(cam.samples_per_pixel) + "spp.txt");
+    if (std::ifstream in(null_file); !(cached && in >> null_rate)) {
+        if (!make_reference)
+            throw std::runtime_error("no chance failure rate for scene " + name + " at " + std::to_string(cam.samples_per_pixel)
+                                     + " spp in " + null_file.string()
+                                     + ": run validate --make-reference with the same options from a known-good build first");
+        std::clog << "measuring the chance failure rate for " << name << " at " << cam.samples_per_pixel << " spp...\n";
+        sample_stats null_render;
+        render_stats(cam, world, threads, null_render);
+        null_rate = failing_pixels(null_render, reference, g.z) / pixels;
+        if (!(std::ofstream(null_file) << null_rate << "\n"))
+            throw std::runtime_error("could not write the chance failure rate " + null_file.string());
+    }
+
+    if (make_reference) {
+        std::cout << "scene " << name << " " << cam.image_width << "x" << cam.height() << ": reference " << reference.samples
+                  << " spp" << (cached ? " (already cached)" : "") << ", " << 100 * null_rate << "% of pixels fail by chance at "
+                  << cam.samples_per_pixel << " spp, in " << cache.string() << "\n";
+        return true;
+    }
+    double p = std::fmax(null_rate, 1 / pixels);
+    double max_fail_fraction = g.max_fail_fraction >= 0 ? g.max_fail_fraction
+                             : null_rate + g.calibration_z * std::sqrt(2 * p * (1 - p) / pixels);
+
+    sample_stats candidate;
+    double seconds = render_stats(cam, world, threads, candidate);
+    double msamples_per_s = double(candidate.sum.size()) * candidate.samples / seconds / 1e6;
+    double fail_fraction = failing_pixels(candidate, reference, g.z) / pixels;
+
+    // whole-image mean difference, with the variance of each pixel's channel total (its channels are correlated)
+    double bias = 0, bias_variance = 0;
+    for (size_t i = 0; i < candidate.sum.size(); i++) {
+        color diff = candidate.mean(i) - reference.mean(i);
+        bias += diff.x() + diff.y() + diff.z();
+        bias_variance += reference.total_variance(i) * (1.0 / candidate.samples + 1.0 / reference.samples);
+    }
+    double n = 3.0 * candidate.sum.size();
+    bias /= n;
+    double bias_bound = g.bias_z * std::sqrt(bias_variance) / n;
+
+    auto ref_image = reference.display(), cand_image = candidate.display();
+    double error = rmse(ref_image, cand_image);
+    double similarity = ssim(ref_image, cand_image);
+    double flip = flip_metric::mean(ref_image, cand_image);
+
+    bool pass_pixels = fail_fraction <= max_fail_fraction;
+    bool pass_bias = std::fabs(bias) <= bias_bound;
+    bool pass_rmse = error <= g.max_rmse, pass_ssim = similarity >= g.min_ssim, pass_flip = flip <= g.max_flip;
+    bool pass = pass_pixels && pass_bias && pass_rmse && pass_ssim && pass_flip;
+    auto mark = [](bool ok) { return ok ? "" : "  <-- FAIL"; };
+
+    std::cout << std::fixed << std::setprecision(4)
+              << "scene " << name << " (" << build_kind << " build) " << cam.image_width << "x" << cam.height()
+              << ": reference " << reference.samples << " spp"
+              << ", candidate " << candidate.samples << " spp\n"
+              << "  throughput   " << std::setprecision(3) << msamples_per_s << " Msamples/s (" << seconds << " s)\n"
+              << std::setprecision(4)
+              << "  pixel test   " << 100 * fail_fraction << "% of pixels differ at |z| > " << g.z
+              << " (gate " << 100 * max_fail_fraction << "%, " << 100 * null_rate << "% by chance)" << mark(pass_pixels) << "\n"
+              << std::setprecision(6)
+              << "  mean bias    " << bias << " +- " << bias_bound << mark(pass_bias) << "\n"
+              << std::setprecision(4)
+              << "  rmse         " << error << " (psnr " << std::setprecision(2) << psnr(error) << " dB, gate "
+              << std::setprecision(4) << g.max_rmse << ")" << mark(pass_rmse) << "\n"
+              << "  ssim         " << similarity << " (gate " << g.min_ssim << ")" << mark(pass_ssim) << "\n"
+              << "  flip         " << flip << " (gate " << g.max_flip << ")" << mark(pass_flip) << "\n"
+              << "  " << (pass ? "PASS" : "FAIL") << "\n";
+
+    // one machine readable line per scene, for collecting speed/accuracy pairs across builds
+    std::cout << std::setprecision(6)
+              << "RESULT scene=" << name << " build=" << build_kind << " msamples_per_s=" << msamples_per_s << " fail_fraction=" << fail_fraction
+              << " bias=" << bias << " rmse=" << error << " ssim=" << similarity << " flip=" << flip
+              << " status=" << (pass ? "PASS" : "FAIL") << "\n";
+    return pass;
+}
+
+int main(int argc, char* argv[]) {
+    std::map<std::string, std::string> options;
+    for (int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if (key.rfind("--", 0) != 0) {
+            std::cerr << "validate: expected an option, got '" << key << "'\n";
+            return 2;
+        }
+        if (key == "--make-reference") {
+            options["make-reference"] = "";
+            continue;
+        }
+        if (i + 1 == argc) {
+            std::cerr << "validate: option '" << key << "' needs a value\n";
+            return 2;
+        }
+        options[key.substr(2)] = argv[++i];
+    }
+
+    // a fast-math reference or chance rate would let fast-math candidates pass on their own errors
+    if (options.count("make-reference") && std::string(build_kind) != "exact") {
+        std::cerr << "validate: --make-reference needs an exact build, this one renders with " << build_kind << " kernels\n";
+        return 2;
+    }
+
+    gates g;
+    if (options.count("max-fail-fraction")) g.max_fail_fraction = std::stod(options["max-fail-fraction"]);
+    if (options.count("max-rmse")) g.max_rmse = std::stod(options["max-rmse"]);
+    if (options.count("min-ssim")) g.min_ssim = std::stod(options["min-ssim"]);
+    if (options.count("max-flip")) g.max_flip = std::stod(options["max-flip"]);
+
+    bool all_passed = true;
+    bool found = false;
+    for (const auto& [name, build] : scene_catalog()) {
+        if (options.count("scene") && options["scene"] != name)
+            continue;
+        found = true;
+        try {
+            all_passed &= validate_scene(name, build, options, g);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "validate: " << e.what() << "\n";
+            return 2;
+        }
+    }
+
+    if (!found) {
+        std::cerr << "validate: unknown scene '" << options["scene"] << "'\n";
+        return 2;
+    }
+    return all_passed ? 0 : 1;
+}
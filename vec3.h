@@ -117,30 +117,54 @@ inline vec3 cross(const vec3& u, const vec3& v) {
 }
 
 inline vec3 unit_vector(vec3 v) {
+#ifdef RT_FAST_MATH
+    return v * fast_rsqrt(v.length_squared());
+#else
     return v / v.length();
+#endif
 }
 
 // generates random vectors until one lands within unit circle (-1,1 on only x and y axes)
 inline vec3 random_in_unit_disk() {
+#ifdef RT_FAST_MATH
+    // sampled directly instead: no rejected tries
+    vec3 p;
+    fast_unit_disk_point(random_double(), random_double(), p[0], p[1]);
+    return p;
+#else
     while (true) {
         auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
         if (p.length_squared() < 1)
             return p;
     }
+#endif
 }
 
 // generates random vectors until one lands within unit sphere (sphere drawn within -1,1 unit cube)
 inline vec3 random_in_unit_sphere() {
+#ifdef RT_FAST_MATH
+    vec3 p;
+    fast_unit_ball_point(random_double(), random_double(), random_double(), p[0], p[1], p[2]);
+    return p;
+#else
     while (true) {
         auto p = vec3::random(-1,1);
         if (p.length_squared() < 1)
             return p;
     }
+#endif
 }
 
 // unit sphere vector normalized to unit length
 inline vec3 random_unit_vector() {
+#ifdef RT_FAST_MATH
+    // a point on the sphere directly, rather than normalizing a point inside it
+    vec3 p;
+    fast_unit_sphere_direction(random_double(), random_double(), p[0], p[1], p[2]);
+    return p;
+#else
     return unit_vector(random_in_unit_sphere());
+#endif
 }
 
 // dot product between unit sphere vector and surface normal to determine whether unit sphere vector is on, or needs to be flipped to, correct hemisphere